@@ -0,0 +1,359 @@
+/*==============================================================================
+
+   Purpose          : 2D gravitational N-body calculation with MPI
+
+==============================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <mpi.h>
+#include <libFHBRS.h>
+
+// type for indices and dimensions
+typedef int idx_t;
+
+// uncomment to get debug output (run only with small data sizes!)
+//#define DEBUG 1
+
+
+//==============================================================================
+// runtime error check macros
+
+// check for MPI error
+#define checkMpiError(err) {if((err) != MPI_SUCCESS) {printf("MPI error in file %s, line %d\n", __FILE__, __LINE__);}}
+// check for true and print error message if not
+#define check(b) {if(!(b)) {printf("runtime error in file %s, line %d\n", __FILE__, __LINE__);}}
+
+
+//==============================================================================
+// physics (same values as in the shared memory version PragmaOMP/nbody)
+
+#define G 6.673e-11               // gravitational constant in m^3/(kg*s^2)
+#define EPSILON 1e-5              // bodies must not come as close as this
+#define SQR(x) ((x) * (x))
+
+#define CHECKSUM_REFERENCE 6956984643621UL
+
+// values of a block of bodies that are passed around the ring
+enum {RING_X, RING_Y, RING_MASS, RING_VALUES};
+
+
+//==============================================================================
+// simulation parameters (command line)
+
+static idx_t nBody = 1000;
+static double bodyMassFactor = 1e26;
+static double bodyVelocityFactor = 1e4;
+static double bodyDistanceFactor = 1e12;
+static double tEnd = 1e100;
+static double dt = 10.0 * 60.0;
+static int bounce = 0;
+
+
+//==============================================================================
+/** determine local block size such that an index space is distributed evenly
+ * over all processes (and filled up with one additional element if necessary)
+ * @param n global size
+ * @param p number of processes
+ * @return local block size
+ */
+static idx_t localBlockSize(idx_t n, idx_t p) {
+  // determine local block size
+  idx_t blockSize = n / p;
+  if(n % p != 0) {
+    blockSize++;
+  }
+
+  return blockSize;
+}
+
+//==============================================================================
+/** number of bodies in the block of a process (the last blocks may be
+ * smaller or even empty)
+ * @param proc process rank
+ * @param blockSize block size
+ * @return number of bodies owned by proc
+ */
+static idx_t blockCount(int proc, idx_t blockSize) {
+  idx_t first = proc * blockSize;
+  if(first >= nBody) {
+    return 0;
+  }
+  return (first + blockSize <= nBody) ? blockSize : nBody - first;
+}
+
+
+//==============================================================================
+/** get command line options (subset of the shared memory version)
+ * @param argc argument count
+ * @param argv argument vector
+ */
+static void getOptions(int argc, char **argv) {
+  for(int i=1; i<argc; i++) {
+    int ok = 1;
+    if(!strcmp("-bodies", argv[i])) {
+      ok = (++i < argc) && (sscanf(argv[i], "%d", &nBody) == 1) && (nBody > 0);
+    } else if(!strcmp("-timesteps", argv[i])) {
+      ok = (++i < argc) && (sscanf(argv[i], "%lf", &dt) == 1);
+    } else if(!strcmp("-t_end", argv[i])) {
+      ok = (++i < argc) && (sscanf(argv[i], "%lf", &tEnd) == 1);
+    } else if(!strcmp("-massfactor", argv[i])) {
+      ok = (++i < argc) && (sscanf(argv[i], "%lf", &bodyMassFactor) == 1);
+    } else if(!strcmp("-velocityfactor", argv[i])) {
+      ok = (++i < argc) && (sscanf(argv[i], "%lf", &bodyVelocityFactor) == 1);
+    } else if(!strcmp("-distancefactor", argv[i])) {
+      ok = (++i < argc) && (sscanf(argv[i], "%lf", &bodyDistanceFactor) == 1);
+    } else if(!strcmp("-bounce", argv[i])) {
+      bounce = 1;
+    } else {
+      ok = 0;
+    }
+
+    if(!ok) {
+      printf("usage: %s [-bodies n] [-timesteps dt] [-t_end t] [-massfactor m]\n"
+             "\t[-velocityfactor v] [-distancefactor d] [-bounce]\n", argv[0]);
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+  }
+}
+
+
+//==============================================================================
+/** create the local bodies. Every process generates the random values of all
+ * bodies in the same order as the shared memory version and keeps its own
+ * block, so the bodies do not depend on the number of processes.
+ * @param first global index of the first local body
+ * @param count number of local bodies
+ * @param position local positions (x,y interleaved)
+ * @param velocity local velocities (x,y interleaved)
+ * @param mass local masses
+ */
+static void createBodies(idx_t first, idx_t count, double *position, double *velocity, double *mass) {
+  rand_init(0);
+
+  for(idx_t i=0; i<nBody; i++) {
+    double px = (1.0 - 2.0 * rand_standard()) * bodyDistanceFactor;
+    double py = (1.0 - 2.0 * rand_standard()) * bodyDistanceFactor;
+    double vx = 2.0 * (0.5 - rand_standard()) * bodyVelocityFactor;
+    double vy = 2.0 * (0.5 - rand_standard()) * bodyVelocityFactor;
+    double m = rand_standard() * bodyMassFactor;
+
+    if(i >= first && i < first + count) {
+      idx_t k = i - first;
+      position[2*k] = px;
+      position[2*k+1] = py;
+      velocity[2*k] = vx;
+      velocity[2*k+1] = vy;
+      mass[k] = m;
+    }
+  }
+}
+
+
+//==============================================================================
+/** forces of one block of bodies on the local bodies.
+ * The pair values are computed exactly as in the shared memory version
+ * (lower global index first).
+ * @param first global index of the first local body
+ * @param count number of local bodies
+ * @param position local positions
+ * @param mass local masses
+ * @param force partial forces of the block on the local bodies (output)
+ * @param otherFirst global index of the first body in the block
+ * @param otherCount number of bodies in the block
+ * @param block the block (RING_VALUES values per body)
+ */
+static void blockForces(idx_t first, idx_t count, const double *position, const double *mass, double *force,
+                        idx_t otherFirst, idx_t otherCount, const double *block) {
+  for(idx_t i=0; i<count; i++) {
+    double fx = 0.0;
+    double fy = 0.0;
+
+    for(idx_t j=0; j<otherCount; j++) {
+      if(first + i == otherFirst + j) {
+        continue;
+      }
+      const double *b = block + RING_VALUES * j;
+      double r = SQR(position[2*i] - b[RING_X]) + SQR(position[2*i+1] - b[RING_Y]);
+      // avoid numerical instabilities
+      if(r < EPSILON) {
+        r += EPSILON;
+      }
+      double distance = sqrt(r);
+      double magnitude = (first + i < otherFirst + j)
+        ? (G * mass[i] * b[RING_MASS]) / (distance * distance)
+        : (G * b[RING_MASS] * mass[i]) / (distance * distance);
+      double factor = magnitude / distance;
+      fx += factor * (b[RING_X] - position[2*i]);
+      fy += factor * (b[RING_Y] - position[2*i+1]);
+    }
+
+    force[2*i] = fx;
+    force[2*i+1] = fy;
+  }
+}
+
+
+//==============================================================================
+/** one timestep. The blocks of all processes travel around a ring: in round
+ * s every process computes with the block of process rank-s, while the
+ * block is already sent on to the right neighbour and the next one is
+ * received from the left neighbour (non-blocking).
+ * The forces of every block are kept apart and summed up in the order of
+ * the owners after the ring is complete, like the partial forces of the
+ * threads in the shared memory version. So the result does not depend on
+ * the order in which the blocks arrive.
+ * @param blockSize block size
+ * @param position local positions (updated)
+ * @param velocity local velocities (updated)
+ * @param mass local masses
+ * @param force local force buffer
+ * @param partial partial forces of all blocks (size blocks of 2*blockSize)
+ * @param ring two ring buffers of blockSize bodies each
+ */
+static void timestep(idx_t blockSize, double *position, double *velocity, const double *mass,
+                     double *force, double *partial, double *ring[2]) {
+  int rank;
+  int size;
+  checkMpiError(MPI_Comm_rank(MPI_COMM_WORLD, &rank));
+  checkMpiError(MPI_Comm_size(MPI_COMM_WORLD, &size));
+  idx_t first = rank * blockSize;
+  idx_t count = blockCount(rank, blockSize);
+  int left = (rank + size - 1) % size;
+  int right = (rank + 1) % size;
+
+  // own block is the first one in the ring
+  for(idx_t i=0; i<count; i++) {
+    ring[0][RING_VALUES*i + RING_X] = position[2*i];
+    ring[0][RING_VALUES*i + RING_Y] = position[2*i+1];
+    ring[0][RING_VALUES*i + RING_MASS] = mass[i];
+  }
+
+  int cur = 0;
+  for(int s=0; s<size; s++) {
+    int owner = (rank - s + size) % size;
+    MPI_Request req[2];
+
+    if(s < size-1) {
+      checkMpiError(MPI_Irecv(ring[1-cur], RING_VALUES * blockSize, MPI_DOUBLE, left, 4711, MPI_COMM_WORLD, &req[0]));
+      checkMpiError(MPI_Isend(ring[cur], RING_VALUES * blockSize, MPI_DOUBLE, right, 4711, MPI_COMM_WORLD, &req[1]));
+    }
+
+    blockForces(first, count, position, mass, partial + 2 * blockSize * owner,
+                owner * blockSize, blockCount(owner, blockSize), ring[cur]);
+
+    if(s < size-1) {
+      checkMpiError(MPI_Waitall(2, req, MPI_STATUSES_IGNORE));
+      cur = 1 - cur;
+    }
+  }
+
+  // sum up the partial forces in owner order
+  for(idx_t i=0; i<count; i++) {
+    force[2*i] = force[2*i+1] = 0.0;
+    for(int o=0; o<size; o++) {
+      force[2*i] += partial[2 * blockSize * o + 2*i];
+      force[2*i+1] += partial[2 * blockSize * o + 2*i+1];
+    }
+  }
+
+  // move local bodies (same as move_bodies in the shared memory version)
+  for(idx_t i=0; i<count; i++) {
+    for(int d=0; d<2; d++) {
+      double deltaV = force[2*i+d] / mass[i] * dt;
+      double deltaP = (velocity[2*i+d] + deltaV / 2.0) * dt;
+      velocity[2*i+d] += deltaV;
+      position[2*i+d] += deltaP;
+      if(bounce && ((position[2*i+d] < -bodyDistanceFactor) || (position[2*i+d] > bodyDistanceFactor))) {
+        velocity[2*i+d] = -velocity[2*i+d];
+      }
+    }
+  }
+}
+
+
+//==============================================================================
+/** main program. Creates the distributed bodies, runs the time loop and
+    checks the checksum of all positions on process 0.
+ */
+
+int main(int argc, char **argv)
+{
+  // initialize MPI
+  checkMpiError(MPI_Init(&argc, &argv));
+  int rank;
+  int size;
+  checkMpiError(MPI_Comm_rank(MPI_COMM_WORLD, &rank));
+  checkMpiError(MPI_Comm_size(MPI_COMM_WORLD, &size));
+
+  getOptions(argc, argv);
+
+  // local part of the bodies
+  idx_t blockSize = localBlockSize(nBody, (idx_t)size);
+  idx_t first = rank * blockSize;
+  idx_t count = blockCount(rank, blockSize);
+#if defined(DEBUG)
+  printf("[%3d] bodies %d..%d\n", rank, first, first + count - 1);
+#endif
+  double *position = malloc(2 * blockSize * sizeof(*position));
+  double *velocity = malloc(2 * blockSize * sizeof(*velocity));
+  double *mass = malloc(blockSize * sizeof(*mass));
+  double *force = malloc(2 * blockSize * sizeof(*force));
+  double *partial = malloc(2 * blockSize * size * sizeof(*partial));
+  double *ring[2];
+  ring[0] = malloc(RING_VALUES * blockSize * sizeof(*ring[0]));
+  ring[1] = malloc(RING_VALUES * blockSize * sizeof(*ring[1]));
+  check(position != NULL && velocity != NULL && mass != NULL && force != NULL && partial != NULL && ring[0] != NULL && ring[1] != NULL);
+  createBodies(first, count, position, velocity, mass);
+
+  // time loop
+  checkMpiError(MPI_Barrier(MPI_COMM_WORLD));
+  double t0 = gettime();
+  for(double t=0; t<tEnd; t+=dt) {
+    timestep(blockSize, position, velocity, mass, force, partial, ring);
+  }
+  t0 = gettime() - t0;
+
+  // checksum: sum of rounded positions (unsigned arithmetic, so the order
+  // of summation does not matter)
+  unsigned long cs = 0;
+  for(idx_t i=0; i<2*count; i++) {
+    cs += (unsigned long)round(position[i]);
+  }
+  unsigned long csAll = 0;
+  checkMpiError(MPI_Reduce(&cs, &csAll, 1, MPI_UNSIGNED_LONG, MPI_SUM, 0, MPI_COMM_WORLD));
+  double tMax = 0.0;
+  checkMpiError(MPI_Reduce(&t0, &tMax, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD));
+
+  if(rank == 0) {
+    printf("[%3d] n=%8d, p=%4d, time nbody : %.6f\n", rank, nBody, size, tMax);
+    long diff = (long)(csAll - CHECKSUM_REFERENCE);
+    if(diff < -2 || diff > 2) {
+      printf("error checksum wrong:\n"
+             "\texpected=%lu\n"
+             "\tseen    =%lu\n",
+             CHECKSUM_REFERENCE, csAll);
+    } else {
+      printf("checksum OK: %lu\n", csAll);
+    }
+  }
+
+  // free memory
+  free(position);
+  free(velocity);
+  free(mass);
+  free(force);
+  free(partial);
+  free(ring[0]);
+  free(ring[1]);
+
+  checkMpiError(MPI_Finalize());
+  return 0;
+}
+
+/*============================================================================*
+ *                             that's all folks                               *
+ *============================================================================*/
@@ -9,16 +9,27 @@
 
 ==============================================================================*/
 
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <math.h>
+#include <signal.h>
 #include <unistd.h>
+#include <sys/time.h>
+
+#include <omp.h>
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
 
 #include <libFHBRS.h>
 
-#define X_RESOLUTION 1000 /* number of pixels in x-direction */
-#define Y_RESOLUTION 800  /* number of pixels in y-direction */
+#define X_RESOLUTION 1000 /* default number of pixels in x-direction */
+#define Y_RESOLUTION 800  /* default number of pixels in y-direction */
+
+#define MIN(x, y) (((x) < (y)) ? (x) : (y))
+#define MAX(x, y) (((x) > (y)) ? (x) : (y))
 
 /*==============================================================================*/
 
@@ -28,12 +39,113 @@ static int display = 1;
 static unsigned long checksum = 0;
 #define REFERENCE_CHECKSUM 3775983838UL
 
+// image size, may be changed with -size
+static int x_resolution = X_RESOLUTION, y_resolution = Y_RESOLUTION;
+
+// compute into a buffer of iteration counts instead of drawing every point
+static int use_buffer = 0;
+static int *iterations = NULL; // iterations[j][i], one writer per pixel
+#define ITERATIONS(i, j) iterations[(size_t)(j) * x_resolution + (i)]
+// write image to this file (binary PGM) after the calculation
+static char *output_file = NULL;
+// tile size for the tile renderer (0: columns with static schedule)
+static int tile_x = 0, tile_y = 0;
+// print pixels, iterations and time per thread
+static int show_thread_stats = 0;
+// iterate several pixels at once with the SIMD kernel
+static int use_simd = 0;
+// Mariani-Silver subdivision: only iterate rectangle borders
+static int use_subdivision = 0;
+#define SUBDIVISION_MIN 6    // rectangles with smaller interior are iterated
+#define SUBDIVISION_TASK 4096 // no more tasks for rectangles smaller than this
+// fast paths for interior points: cardioid/bulb test, periodicity check
+static int use_cardioid = 0;
+static int use_periodicity = 0;
+static unsigned long cardioid_pixels = 0;    // pixels decided by the cardioid/bulb test
+static unsigned long periodicity_pixels = 0; // pixels decided by a detected cycle
+// deep zoom with perturbation: center (decimal strings) and radius
+static char *deep_real = NULL, *deep_imag = NULL;
+static double deep_radius = 0.0;
+static int use_series = 0;       // skip iterations with series approximation
+static unsigned long rebases = 0; // pixels switched back to the reference start
+// compute bands of stream_rows rows and write them while computing,
+// the whole image is never kept in memory
+static char *stream_file = NULL;
+static int stream_rows = 0;
+// progressive rendering: levels with every 16th, 4th and every pixel,
+// cancelled when the view changes (Ctrl-C or after cancel_time seconds)
+static int use_progressive = 0;
+static double cancel_time = 0.0;
+static volatile sig_atomic_t view_changed = 0;
+static int progressive_cancelled = 0;
+static const int level_stride[] = {16, 4, 1};
+#define N_LEVELS (int)(sizeof(level_stride) / sizeof(level_stride[0]))
+#define PROGRESSIVE_TILE 64 // default tile size of the progressive renderer
+// exploration: sequence of views from a file, tiles from an LRU cache
+static char *explore_file = NULL;
+static double cache_mb = 64.0;   // memory bound of the tile cache
+static int prefetch_ring = 0;    // tiles around the viewport computed in background
+#define CACHE_TILE 64            // tile size of the cache in pixels
+#define CACHE_MAX_ZOOM 20        // pixel indices must fit into int
+// animation: frames from the view of the command line to animate_view
+// (xmin, ymin, xmax, ymax), written to files named with animate_pattern
+static int animate_frames = 0;
+static double animate_view[4];
+static char *animate_pattern = NULL;
+#define ANIMATE_SPLIT 2 // frames above 1/ANIMATE_SPLIT of a thread's share are split
+
+// work per thread, padded to a cache line
+typedef struct
+{
+  unsigned long pixels;
+  unsigned long iterations;
+  double time;
+  char pad[64 - 2 * sizeof(unsigned long) - sizeof(double)];
+} thread_stats_t;
+static thread_stats_t *thread_stats = NULL;
+
 /*==============================================================================*/
 /* get command line arguments
-   a.out xmin ymin xmax ymax maxiter
-   example a.out -2 -2 2 2 1000
+   a.out xmin ymin xmax ymax maxiter display [options]
+   example a.out -2 -2 2 2 1000 0 -buffer
  */
 
+static void usage(char *name)
+{
+  fprintf(stderr, "usage: %s xmin ymin xmax ymax maxiter display [options]\n"
+                  "options:\n"
+                  "\t-size w h   image of w x h pixels (default %d x %d)\n"
+                  "\t-buffer     compute into a pixel buffer, draw it afterwards\n"
+                  "\t-output f   write image as PGM file f, PPM if f ends with .ppm (implies -buffer)\n"
+                  "\t-tiles w h  tiles of w x h pixels, dynamic schedule (implies -buffer)\n"
+                  "\t-simd       AVX2/AVX-512 kernel, several pixels at once (implies -buffer)\n"
+                  "\t-subdivide  Mariani-Silver rectangle subdivision with tasks (implies -buffer)\n"
+                  "\t-cardioid   no iteration for points in main cardioid and period 2 bulb\n"
+                  "\t-periodicity stop iteration when the orbit is periodic (Brent)\n"
+                  "\t-deepzoom x y r  perturbation renderer for the view with center x+iy\n"
+                  "\t            (any number of digits) and radius r, ignores xmin..ymax\n"
+                  "\t-series     skip first iterations with series approximation (-deepzoom)\n"
+                  "\t-progressive levels with 1/16, 1/4 and full resolution, every level is\n"
+                  "\t            shown when ready, coarse pixels are reused (implies -buffer),\n"
+                  "\t            single pixels are iterated, -simd does not apply\n"
+                  "\t-cancel t   view change after t seconds: cancel the running level (-progressive)\n"
+                  "\t-explore f  render the views of file f (lines: center x, center y, zoom\n"
+                  "\t            level; pixel size of level z is (xmax-xmin)/width/2^z) with a\n"
+                  "\t            cache of tiles, a pan only computes the newly exposed tiles\n"
+                  "\t-cache m    memory bound of the tile cache in MB (default 64, -explore)\n"
+                  "\t-prefetch r compute r tiles around the viewport in background (-explore)\n"
+                  "\t-animate n x1 y1 x2 y2 f  n frames zooming from xmin..ymax to the view\n"
+                  "\t            (x1,y1)-(x2,y2), frame k is written to file f with %%d for k\n"
+                  "\t            (e.g. frame%%05d.pgm, color for .ppm), no display\n"
+                  "\t-stream f h compute bands of h rows in parallel and write them in order\n"
+                  "\t            to f while computing (PGM, color PPM if f ends with .ppm),\n"
+                  "\t            no pixel buffer and no display\n"
+                  "\t-threadstats print pixels, iterations and time per thread (implies -buffer)\n",
+          name, X_RESOLUTION, Y_RESOLUTION);
+  exit(EXIT_FAILURE);
+}
+
+
 static void get_arguments(int argc,     // I: argument count
                           char **argv,  // I: argument vector
                           double *xmin, // O: minimum x coordinate
@@ -44,11 +156,12 @@ static void get_arguments(int argc,     // I: argument count
                           int *display  // O: show graphic
 )
 {
-  if (argc != 7)
+  int i;
+
+  if (argc < 7)
   {
     fprintf(stderr, "%s: wrong command line arguments\n", argv[0]);
-    fprintf(stderr, "usage: %s xmin ymin xmax ymax maxiter display\n", argv[0]);
-    exit(EXIT_FAILURE);
+    usage(argv[0]);
   }
 
   *xmin = atof(argv[1]);
@@ -57,6 +170,288 @@ static void get_arguments(int argc,     // I: argument count
   *ymax = atof(argv[4]);
   *maxiter = atoi(argv[5]);
   *display = atoi(argv[6]);
+
+  for (i = 7; i < argc; i++)
+  {
+    if (!strcmp("-size", argv[i]))
+    {
+      if ((i + 2 >= argc) || ((x_resolution = atoi(argv[i + 1])) < 2) || ((y_resolution = atoi(argv[i + 2])) < 2))
+        usage(argv[0]);
+      i += 2;
+    }
+
+    else if (!strcmp("-buffer", argv[i]))
+      use_buffer = 1;
+
+    else if (!strcmp("-output", argv[i]))
+    {
+      if (++i >= argc)
+        usage(argv[0]);
+      output_file = argv[i];
+      use_buffer = 1;
+    }
+
+    else if (!strcmp("-tiles", argv[i]))
+    {
+      if ((i + 2 >= argc) || ((tile_x = atoi(argv[i + 1])) < 1) || ((tile_y = atoi(argv[i + 2])) < 1))
+        usage(argv[0]);
+      i += 2;
+      use_buffer = 1;
+    }
+
+    else if (!strcmp("-simd", argv[i]))
+    {
+      use_simd = 1;
+      use_buffer = 1;
+    }
+
+    else if (!strcmp("-subdivide", argv[i]))
+    {
+      use_subdivision = 1;
+      use_buffer = 1;
+    }
+
+    else if (!strcmp("-cardioid", argv[i]))
+    {
+      use_cardioid = 1;
+      use_buffer = 1;
+    }
+
+    else if (!strcmp("-periodicity", argv[i]))
+    {
+      use_periodicity = 1;
+      use_buffer = 1;
+    }
+
+    else if (!strcmp("-deepzoom", argv[i]))
+    {
+      if ((i + 3 >= argc) || (sscanf(argv[i + 3], "%lf", &deep_radius) != 1) || (deep_radius <= 0.0))
+        usage(argv[0]);
+      deep_real = argv[i + 1];
+      deep_imag = argv[i + 2];
+      i += 3;
+      use_buffer = 1;
+    }
+
+    else if (!strcmp("-series", argv[i]))
+      use_series = 1;
+
+    else if (!strcmp("-progressive", argv[i]))
+    {
+      use_progressive = 1;
+      use_buffer = 1;
+    }
+
+    else if (!strcmp("-cancel", argv[i]))
+    {
+      if ((i + 1 >= argc) || (sscanf(argv[i + 1], "%lf", &cancel_time) != 1) || (cancel_time <= 0.0))
+        usage(argv[0]);
+      i++;
+    }
+
+    else if (!strcmp("-explore", argv[i]))
+    {
+      if (++i >= argc)
+        usage(argv[0]);
+      explore_file = argv[i];
+      use_buffer = 1;
+    }
+
+    else if (!strcmp("-cache", argv[i]))
+    {
+      if ((i + 1 >= argc) || (sscanf(argv[i + 1], "%lf", &cache_mb) != 1) || (cache_mb <= 0.0))
+        usage(argv[0]);
+      i++;
+    }
+
+    else if (!strcmp("-prefetch", argv[i]))
+    {
+      if ((i + 1 >= argc) || ((prefetch_ring = atoi(argv[i + 1])) < 0))
+        usage(argv[0]);
+      i++;
+    }
+
+    else if (!strcmp("-animate", argv[i]))
+    {
+      int k;
+      if ((i + 6 >= argc) || ((animate_frames = atoi(argv[i + 1])) < 1))
+        usage(argv[0]);
+      for (k = 0; k < 4; k++)
+        if (sscanf(argv[i + 2 + k], "%lf", &animate_view[k]) != 1)
+          usage(argv[0]);
+      if ((animate_view[0] >= animate_view[2]) || (animate_view[1] >= animate_view[3]))
+      {
+        fprintf(stderr, "%s: end view of -animate needs x1 < x2 and y1 < y2\n", argv[0]);
+        usage(argv[0]);
+      }
+      animate_pattern = argv[i + 6];
+      i += 6;
+    }
+
+    else if (!strcmp("-stream", argv[i]))
+    {
+      if ((i + 2 >= argc) || ((stream_rows = atoi(argv[i + 2])) < 1))
+        usage(argv[0]);
+      stream_file = argv[i + 1];
+      i += 2;
+    }
+
+    else if (!strcmp("-threadstats", argv[i]))
+    {
+      show_thread_stats = 1;
+      use_buffer = 1;
+    }
+
+    else
+    {
+      fprintf(stderr, "%s: unknown option %s\n", argv[0], argv[i]);
+      usage(argv[0]);
+    }
+  }
+
+  if (stream_file != NULL)
+  {
+    // the options that need the whole image at once
+    if (use_subdivision || use_progressive || (explore_file != NULL) || (deep_real != NULL) ||
+        (output_file != NULL) || (tile_x > 0))
+    {
+      fprintf(stderr, "%s: -stream does not work with -subdivide, -progressive, -explore, -deepzoom, -output and -tiles\n",
+              argv[0]);
+      usage(argv[0]);
+    }
+    use_buffer = 0;
+  }
+  if (use_subdivision && (tile_x > 0))
+  {
+    fprintf(stderr, "%s: -subdivide does not work with -tiles\n", argv[0]);
+    usage(argv[0]);
+  }
+  if ((cancel_time > 0.0) && !use_progressive)
+  {
+    fprintf(stderr, "%s: -cancel needs -progressive\n", argv[0]);
+    usage(argv[0]);
+  }
+  if (use_progressive && (use_subdivision || (deep_real != NULL)))
+  {
+    fprintf(stderr, "%s: -progressive does not work with -subdivide and -deepzoom\n", argv[0]);
+    usage(argv[0]);
+  }
+  if ((explore_file != NULL) && (use_subdivision || use_progressive || (deep_real != NULL) || (tile_x > 0)))
+  {
+    fprintf(stderr, "%s: -explore does not work with -subdivide, -progressive, -deepzoom and -tiles\n", argv[0]);
+    usage(argv[0]);
+  }
+  if (animate_frames > 0)
+  {
+    const char *p = strchr(animate_pattern, '%');
+
+    // exactly one conversion %d, optionally with zero padding and width
+    if (p != NULL)
+      p += 1 + strspn(p + 1, "0123456789");
+    if ((p == NULL) || (*p != 'd') || (strchr(p, '%') != NULL))
+    {
+      fprintf(stderr, "%s: file name %s for -animate needs one %%d\n", argv[0], animate_pattern);
+      usage(argv[0]);
+    }
+    if (use_subdivision || use_progressive || (explore_file != NULL) || (stream_file != NULL) ||
+        (deep_real != NULL) || (output_file != NULL) || (tile_x > 0))
+    {
+      fprintf(stderr, "%s: -animate does not work with -subdivide, -progressive, -explore, -stream, "
+                      "-deepzoom, -output and -tiles\n", argv[0]);
+      usage(argv[0]);
+    }
+    use_buffer = 0;
+  }
+  // without an image in memory there is nothing to draw, so no window is opened
+  if (((stream_file != NULL) || (animate_frames > 0)) && *display)
+  {
+    printf("no display with -stream and -animate\n");
+    *display = 0;
+  }
+}
+
+/*==============================================================================*/
+/* number of iterations for point c (at least 1, at most maxiter) */
+
+static inline int
+iterate(double c_real, double c_imag, int maxiter)
+{
+  double z_real = 0.0, z_imag = 0.0, temp, absvalue;
+  int k = 0;
+
+  do
+  {
+    temp = z_real * z_real - z_imag * z_imag + c_real;
+    z_imag = 2.0 * z_real * z_imag + c_imag;
+    z_real = temp;
+    absvalue = z_real * z_real + z_imag * z_imag;
+    k++;
+  } while (absvalue < 4.0 && k < maxiter);
+
+  return k;
+}
+
+/*==============================================================================*/
+/* point c in the main cardioid or in the period 2 bulb (never escapes) */
+
+static inline int
+in_cardioid(double c_real, double c_imag)
+{
+  double x = c_real - 0.25, y2 = c_imag * c_imag;
+  double q = x * x + y2;
+
+  return (q * (q + x) < 0.25 * y2) || ((c_real + 1.0) * (c_real + 1.0) + y2 < 0.0625);
+}
+
+/*==============================================================================*/
+/* iterate() with fast paths for interior points, *shortcut tells which one
+   decided (0: none, 1: cardioid/bulb, 2: periodicity).
+
+   Periodicity check after Brent: z is saved at iteration 1, 2, 4, 8, ...
+   and compared with the following iterates. Only exact equality counts:
+   the iteration is deterministic, so a repeated z repeats forever and the
+   point would run into maxiter, the result is the same as with iterate(). */
+
+static inline int
+iterate_fast(double c_real, double c_imag, int maxiter, int *shortcut)
+{
+  double z_real = 0.0, z_imag = 0.0, temp, absvalue;
+  double saved_real = 0.0, saved_imag = 0.0;
+  int k = 0, power = 1, steps = 0;
+
+  *shortcut = 0;
+  if (use_cardioid && in_cardioid(c_real, c_imag))
+  {
+    *shortcut = 1;
+    return maxiter;
+  }
+  if (!use_periodicity)
+    return iterate(c_real, c_imag, maxiter);
+
+  do
+  {
+    temp = z_real * z_real - z_imag * z_imag + c_real;
+    z_imag = 2.0 * z_real * z_imag + c_imag;
+    z_real = temp;
+    absvalue = z_real * z_real + z_imag * z_imag;
+    k++;
+
+    if ((z_real == saved_real) && (z_imag == saved_imag))
+    {
+      *shortcut = 2;
+      return maxiter;
+    }
+    if (++steps == power)
+    {
+      // new reference point, search for a period up to twice as long
+      saved_real = z_real;
+      saved_imag = z_imag;
+      power *= 2;
+      steps = 0;
+    }
+  } while (absvalue < 4.0 && k < maxiter);
+
+  return k;
 }
 
 /*==============================================================================*/
@@ -79,74 +474,1824 @@ drawPoint(int window, int i, int j, int anziter, int maxiter)
 }
 
 /*==============================================================================*/
-/* main program */
+/* compute the points [i0,i1) x [j0,j1) into out, which holds point (i0,j0)
+   and has rows of length ld, returns the sum of the iterations */
 
-int main(int argc, char **argv)
+static unsigned long
+calculate_block(int *out, size_t ld, int i0, int i1, int j0, int j1,
+                double xmin, double ymin, double dx, double dy, int maxiter)
 {
-  int i, j, k, maxiter;
-  double absvalue, temp;
-  struct
+  unsigned long sum = 0, n_cardioid = 0, n_periodicity = 0;
+  int i, j, k, shortcut;
+
+  if (use_cardioid || use_periodicity)
   {
-    double real, imag;
-  } z, c;
-  double xmin, ymin, xmax, ymax;
-  double dx, dy;
-  double t_start, t_end;
-  char ch;
-  int window = 0;
+    for (i = i0; i < i1; i++)
+      for (j = j0; j < j1; j++)
+      {
+        k = iterate_fast(xmin + i * dx, ymin + j * dy, maxiter, &shortcut);
+        out[(j - j0) * ld + (i - i0)] = k;
+        sum += k;
+        n_cardioid += (shortcut == 1);
+        n_periodicity += (shortcut == 2);
+      }
+#pragma omp atomic
+    cardioid_pixels += n_cardioid;
+#pragma omp atomic
+    periodicity_pixels += n_periodicity;
+    return sum;
+  }
 
-  /* initialisation */
-  get_arguments(argc, argv, &xmin, &ymin, &xmax, &ymax, &maxiter, &display);
+  for (i = i0; i < i1; i++)
+    for (j = j0; j < j1; j++)
+    {
+      k = iterate(xmin + i * dx, ymin + j * dy, maxiter);
+      out[(j - j0) * ld + (i - i0)] = k;
+      sum += k;
+    }
 
-  if (display)
-    window = graphic_start(X_RESOLUTION, Y_RESOLUTION, argv[0]);
-  dx = (xmax - xmin) / X_RESOLUTION;
-  dy = (ymax - ymin) / Y_RESOLUTION;
-  printf("display of (%.5f,%.5f)-(%.5f,%.5f) in steps of (%.5f,%.5f)\n",
-         xmin, ymin, xmax, ymax, dx, dy);
+  return sum;
+}
 
-  /* get start time */
-  t_start = gettime();
+/*==============================================================================*/
+/* SIMD version of calculate_block()
 
-/*--------------------------------------------------------------------------*/
+   SIMD_WIDTH pixels are iterated in lockstep, one per vector lane, with
+   the same operations in the same order as iterate(), so the iteration
+   counts are exactly those of the scalar loop. Escaped lanes are found
+   with a compare mask; only then the vectors are stored, the iteration
+   counts of these lanes written, and the lanes refilled with the next
+   pixels of the block, so no lane waits for the slowest pixel. Lanes
+   without a pixel left are masked out. With -cardioid, interior points are
+   skipped when a lane is refilled; -periodicity is not used here. */
 
-/* calculate values for every point in complex plane */
-#pragma omp parallel for private(j, k, z, c, temp, absvalue)
-  for (i = 0; i < X_RESOLUTION; i++)
+#if defined(__AVX512F__)
+
+#define SIMD_NAME "AVX-512"
+#define SIMD_WIDTH 8
+typedef __m512d vdouble;
+#define VSET(x) _mm512_set1_pd(x)
+#define VLOAD(p) _mm512_load_pd(p)
+#define VSTORE(p, v) _mm512_store_pd(p, v)
+#define VADD(a, b) _mm512_add_pd(a, b)
+#define VSUB(a, b) _mm512_sub_pd(a, b)
+#define VMUL(a, b) _mm512_mul_pd(a, b)
+// bit mask of the lanes with a < b and c < d
+#define VLESS2(a, b, c, d) \
+  ((int)(_mm512_cmp_pd_mask(a, b, _CMP_LT_OQ) & _mm512_cmp_pd_mask(c, d, _CMP_LT_OQ)))
+
+#elif defined(__AVX2__)
+
+#define SIMD_NAME "AVX2"
+#define SIMD_WIDTH 4
+typedef __m256d vdouble;
+#define VSET(x) _mm256_set1_pd(x)
+#define VLOAD(p) _mm256_load_pd(p)
+#define VSTORE(p, v) _mm256_store_pd(p, v)
+#define VADD(a, b) _mm256_add_pd(a, b)
+#define VSUB(a, b) _mm256_sub_pd(a, b)
+#define VMUL(a, b) _mm256_mul_pd(a, b)
+#define VLESS2(a, b, c, d) \
+  _mm256_movemask_pd(_mm256_and_pd(_mm256_cmp_pd(a, b, _CMP_LT_OQ), _mm256_cmp_pd(c, d, _CMP_LT_OQ)))
+
+#endif
+
+#if defined(SIMD_WIDTH)
+
+static unsigned long
+calculate_block_simd(int *out, size_t ld, int i0, int i1, int j0, int j1,
+                     double xmin, double ymin, double dx, double dy, int maxiter)
+{
+  double c_real[SIMD_WIDTH] __attribute__((aligned(64)));
+  double c_imag[SIMD_WIDTH] __attribute__((aligned(64)));
+  double z_real[SIMD_WIDTH] __attribute__((aligned(64)));
+  double z_imag[SIMD_WIDTH] __attribute__((aligned(64)));
+  double count[SIMD_WIDTH] __attribute__((aligned(64)));
+  int pixel[SIMD_WIDTH];
+  int height = j1 - j0, n = (i1 - i0) * height, next = 0;
+  int active = 0, done = (1 << SIMD_WIDTH) - 1, l, k;
+  unsigned long sum = 0, n_cardioid = 0;
+  vdouble cr, ci, zr, zi, kv, temp, absvalue;
+  const vdouble two = VSET(2.0), four = VSET(4.0), one = VSET(1.0), max = VSET(maxiter);
+
+  // at the begin all lanes are finished and get their first pixel
+  for (;;)
   {
-    for (j = 0; j < Y_RESOLUTION; j++)
+    // write finished pixels and refill their lanes,
+    // lanes without pixel iterate 0 forever
+    for (l = 0; l < SIMD_WIDTH; l++)
+      if (done & (1 << l))
+      {
+        if (active & (1 << l))
+        {
+          int i = i0 + pixel[l] / height, j = j0 + pixel[l] % height;
+          k = (int)count[l];
+          out[(j - j0) * ld + (i - i0)] = k;
+          sum += k;
+        }
+
+        z_real[l] = z_imag[l] = count[l] = c_real[l] = c_imag[l] = 0.0;
+        active &= ~(1 << l);
+        while (next < n)
+        {
+          int i = i0 + next / height, j = j0 + next % height;
+          c_real[l] = xmin + i * dx;
+          c_imag[l] = ymin + j * dy;
+          if (use_cardioid && in_cardioid(c_real[l], c_imag[l]))
+          {
+            // interior point, no lane needed
+            out[(j - j0) * ld + (i - i0)] = maxiter;
+            sum += maxiter;
+            n_cardioid++;
+            next++;
+            continue;
+          }
+          pixel[l] = next++;
+          active |= 1 << l;
+          break;
+        }
+        if (!(active & (1 << l)))
+          c_real[l] = c_imag[l] = 0.0;
+      }
+
+    if (!active)
+      break;
+
+    cr = VLOAD(c_real);
+    ci = VLOAD(c_imag);
+    zr = VLOAD(z_real);
+    zi = VLOAD(z_imag);
+    kv = VLOAD(count);
+
+    // iterate until at least one active lane has finished
+    do
     {
-      /* map point to window */
-      c.real = xmin + i * dx;
-      c.imag = ymin + j * dy;
-      z.real = z.imag = 0.0;
-      k = 0;
+      temp = VADD(VSUB(VMUL(zr, zr), VMUL(zi, zi)), cr);
+      zi = VADD(VMUL(VMUL(two, zr), zi), ci);
+      zr = temp;
+      absvalue = VADD(VMUL(zr, zr), VMUL(zi, zi));
+      kv = VADD(kv, one);
+      done = ~VLESS2(absvalue, four, kv, max) & active;
+    } while (!done);
 
-      // do iterations for point i,j
-      do
+    VSTORE(z_real, zr);
+    VSTORE(z_imag, zi);
+    VSTORE(count, kv);
+  }
+
+  if (n_cardioid > 0)
+  {
+#pragma omp atomic
+    cardioid_pixels += n_cardioid;
+  }
+
+  return sum;
+}
+
+#endif
+
+/*==============================================================================*/
+/* compute all points into the buffer, every pixel is written by exactly one
+   thread and the checksum is a reduction, so no synchronization is needed.
+   Either columns with a static schedule or 2D tiles with a dynamic
+   schedule: the cost of a pixel varies between 1 and maxiter iterations,
+   small tiles handed out on demand balance this. */
+
+#if defined(SIMD_WIDTH)
+#define BLOCK(...) (use_simd ? calculate_block_simd(__VA_ARGS__) : calculate_block(__VA_ARGS__))
+#else
+#define BLOCK(...) calculate_block(__VA_ARGS__)
+#endif
+
+static void
+calculate_buffer(double xmin, double ymin, double dx, double dy, int maxiter)
+{
+  unsigned long sum = 0;
+  int n_tiles_x = (tile_x > 0) ? (x_resolution + tile_x - 1) / tile_x : 0;
+  int n_tiles_y = (tile_y > 0) ? (y_resolution + tile_y - 1) / tile_y : 0;
+
+#pragma omp parallel reduction(+ : sum)
+  {
+    thread_stats_t *stats = &thread_stats[omp_get_thread_num()];
+    double t_thread = omp_get_wtime();
+    unsigned long work;
+    int i, t;
+
+    if (tile_x > 0)
+    {
+#pragma omp for schedule(dynamic) nowait
+      for (t = 0; t < n_tiles_x * n_tiles_y; t++)
       {
-        temp = z.real * z.real - z.imag * z.imag + c.real;
-        z.imag = 2.0 * z.real * z.imag + c.imag;
-        z.real = temp;
-        absvalue = z.real * z.real + z.imag * z.imag;
-        k++;
-      } while (absvalue < 4.0 && k < maxiter);
+        int i0 = (t % n_tiles_x) * tile_x, j0 = (t / n_tiles_x) * tile_y;
+        int i1 = MIN(i0 + tile_x, x_resolution), j1 = MIN(j0 + tile_y, y_resolution);
+        work = BLOCK(&ITERATIONS(i0, j0), x_resolution, i0, i1, j0, j1, xmin, ymin, dx, dy, maxiter);
+        stats->pixels += (unsigned long)(i1 - i0) * (j1 - j0);
+        stats->iterations += work;
+        sum += work;
+      }
+    }
+    else
+    {
+#pragma omp for nowait
+      for (i = 0; i < x_resolution; i++)
+      {
+        work = BLOCK(&ITERATIONS(i, 0), x_resolution, i, i + 1, 0, y_resolution, xmin, ymin, dx, dy, maxiter);
+        stats->pixels += y_resolution;
+        stats->iterations += work;
+        sum += work;
+      }
+    }
 
-// draw point i,j
-#pragma omp critical
-      drawPoint(window, i, j, k, maxiter);
+    stats->time += omp_get_wtime() - t_thread;
+  }
+
+  checksum += sum;
+}
+
+/*==============================================================================*/
+/* Mariani-Silver subdivision
+
+   The iteration count is constant on a connected region bounded by a curve
+   of this count (the Mandelbrot set has no holes), so if all border pixels
+   of a rectangle have the same count, the interior is filled with it.
+   Otherwise the rectangle is split into four by a middle row and column;
+   these lines are iterated by the parent before the children are created
+   as tasks, so every child finds its border computed and every pixel is
+   written by one task only. */
+
+// iterate a block and account it to the executing thread
+static void
+iterate_block(int i0, int i1, int j0, int j1,
+              double xmin, double ymin, double dx, double dy, int maxiter)
+{
+  thread_stats_t *stats = &thread_stats[omp_get_thread_num()];
+
+  if ((i0 >= i1) || (j0 >= j1))
+    return;
+  stats->iterations += BLOCK(&ITERATIONS(i0, j0), x_resolution, i0, i1, j0, j1, xmin, ymin, dx, dy, maxiter);
+  stats->pixels += (unsigned long)(i1 - i0) * (j1 - j0);
+}
+
+// interior of rectangle [i0,i1] x [j0,j1] with computed border
+static void
+subdivide(int i0, int i1, int j0, int j1,
+          double xmin, double ymin, double dx, double dy, int maxiter)
+{
+  int i, j, im, jm, value = ITERATIONS(i0, j0), same = 1;
+
+  if ((i1 - i0 < 2) || (j1 - j0 < 2))
+    return;
+
+  for (i = i0; same && (i <= i1); i++)
+    same = (ITERATIONS(i, j0) == value) && (ITERATIONS(i, j1) == value);
+  for (j = j0; same && (j <= j1); j++)
+    same = (ITERATIONS(i0, j) == value) && (ITERATIONS(i1, j) == value);
+
+  if (same)
+  {
+    // fill interior
+    for (j = j0 + 1; j < j1; j++)
+      for (i = i0 + 1; i < i1; i++)
+        ITERATIONS(i, j) = value;
+    return;
+  }
+
+  if ((i1 - i0 - 1 <= SUBDIVISION_MIN) || (j1 - j0 - 1 <= SUBDIVISION_MIN))
+  {
+    // too small to subdivide
+    iterate_block(i0 + 1, i1, j0 + 1, j1, xmin, ymin, dx, dy, maxiter);
+    return;
+  }
+
+  // middle column and row
+  im = (i0 + i1) / 2;
+  jm = (j0 + j1) / 2;
+  iterate_block(im, im + 1, j0 + 1, j1, xmin, ymin, dx, dy, maxiter);
+  iterate_block(i0 + 1, im, jm, jm + 1, xmin, ymin, dx, dy, maxiter);
+  iterate_block(im + 1, i1, jm, jm + 1, xmin, ymin, dx, dy, maxiter);
+
+#pragma omp task if ((i1 - i0) * (j1 - j0) > SUBDIVISION_TASK)
+  subdivide(i0, im, j0, jm, xmin, ymin, dx, dy, maxiter);
+#pragma omp task if ((i1 - i0) * (j1 - j0) > SUBDIVISION_TASK)
+  subdivide(im, i1, j0, jm, xmin, ymin, dx, dy, maxiter);
+#pragma omp task if ((i1 - i0) * (j1 - j0) > SUBDIVISION_TASK)
+  subdivide(i0, im, jm, j1, xmin, ymin, dx, dy, maxiter);
+  subdivide(im, i1, jm, j1, xmin, ymin, dx, dy, maxiter);
+}
+
+static void
+calculate_subdivision(double xmin, double ymin, double dx, double dy, int maxiter)
+{
+  unsigned long sum = 0, pixels = 0, n = (unsigned long)x_resolution * y_resolution;
+  long l;
+  int i, n_threads = omp_get_max_threads();
+
+#pragma omp parallel
+  {
+    double t_thread = omp_get_wtime();
+
+#pragma omp single
+    {
+      // border of the whole image
+      iterate_block(0, x_resolution, 0, 1, xmin, ymin, dx, dy, maxiter);
+      iterate_block(0, x_resolution, y_resolution - 1, y_resolution, xmin, ymin, dx, dy, maxiter);
+      iterate_block(0, 1, 1, y_resolution - 1, xmin, ymin, dx, dy, maxiter);
+      iterate_block(x_resolution - 1, x_resolution, 1, y_resolution - 1, xmin, ymin, dx, dy, maxiter);
+      subdivide(0, x_resolution - 1, 0, y_resolution - 1, xmin, ymin, dx, dy, maxiter);
     }
-    if (display)
-    // flush graphic
-#pragma omp critical
-      graphic_flush(window);
+
+    // all tasks are done after the barrier of single
+    thread_stats[omp_get_thread_num()].time += omp_get_wtime() - t_thread;
   }
 
-  /*--------------------------------------------------------------------------*/
-  /* get end time */
-  t_end = gettime();
-  printf("calculation took %.2f s\n", t_end - t_start);
-  if (checksum != REFERENCE_CHECKSUM)
+  // filled pixels count as well
+#pragma omp parallel for reduction(+ : sum)
+  for (l = 0; l < (long)n; l++)
+    sum += iterations[l];
+  checksum += sum;
+
+  for (i = 0; i < n_threads; i++)
+    pixels += thread_stats[i].pixels;
+  printf("pixels iterated: %lu of %lu (%.1f%%)\n", pixels, n, 100.0 * pixels / n);
+}
+
+/*==============================================================================*/
+/* draw the whole buffer in one pass */
+
+static void
+draw_buffer(int window, int maxiter)
+{
+  int i, j;
+
+  for (i = 0; i < x_resolution; i++)
+    for (j = 0; j < y_resolution; j++)
+    {
+      int anziter = ITERATIONS(i, j);
+      if (anziter == maxiter)
+        graphic_setColor(window, GRAPHIC_MAX_COLOR - 1);
+      else
+        graphic_setColor(window, anziter % GRAPHIC_MAX_COLOR);
+      graphic_drawPoint(window, i, j);
+    }
+  graphic_flush(window);
+}
+
+/*==============================================================================*/
+/* progressive rendering
+
+   Level l computes the pixels whose coordinates are multiples of
+   level_stride[l] into the full resolution buffer. A pixel of a coarser
+   level lies on the grid of all finer levels and has the same coordinates
+   there, so it is not computed again. The image is divided into tiles
+   with a dynamic schedule on every level. When level l is finished, the
+   master thread draws it with blocks of stride x stride pixels while the
+   other threads already compute level l+1, which writes other pixels only.
+
+   A view change sets view_changed asynchronously (signal handler). The
+   threads then stop their tiles after the current row and skip the
+   remaining tiles of the running level; the level
+   is incomplete and neither drawn nor continued, the last complete level
+   stays on the screen. */
+
+static void
+change_view(int sig)
+{
+  view_changed = 1;
+}
+
+// draw the pixels of a level as blocks of stride x stride pixels
+static void
+draw_level(int window, int stride, int maxiter)
+{
+  int i, j, ib, jb;
+
+  for (j = 0; j < y_resolution; j += stride)
+    for (i = 0; i < x_resolution; i += stride)
+    {
+      int anziter = ITERATIONS(i, j);
+      if (anziter == maxiter)
+        graphic_setColor(window, GRAPHIC_MAX_COLOR - 1);
+      else
+        graphic_setColor(window, anziter % GRAPHIC_MAX_COLOR);
+      for (jb = j; jb < MIN(j + stride, y_resolution); jb++)
+        for (ib = i; ib < MIN(i + stride, x_resolution); ib++)
+          graphic_drawPoint(window, ib, jb);
+    }
+  graphic_flush(window);
+}
+
+static void
+calculate_progressive(int window, double xmin, double ymin, double dx, double dy, int maxiter)
+{
+  int size_x = (tile_x > 0) ? tile_x : PROGRESSIVE_TILE, size_y = (tile_y > 0) ? tile_y : PROGRESSIVE_TILE;
+  int n_tiles_x = (x_resolution + size_x - 1) / size_x, n_tiles_y = (y_resolution + size_y - 1) / size_y;
+  unsigned long sum = 0, level_pixels[N_LEVELS] = {0}, skipped[N_LEVELS] = {0};
+  double level_ready[N_LEVELS], t_start = omp_get_wtime();
+  int l, completed = 0;
+  struct itimerval timer = {{0, 0}, {0, 0}};
+
+  view_changed = 0;
+  signal(SIGINT, change_view);
+  if (cancel_time > 0.0)
+  {
+    signal(SIGALRM, change_view);
+    timer.it_value.tv_sec = (long)cancel_time;
+    timer.it_value.tv_usec = (long)(1e6 * (cancel_time - (long)cancel_time));
+    setitimer(ITIMER_REAL, &timer, NULL);
+  }
+
+#pragma omp parallel private(l) reduction(+ : sum)
+  {
+    thread_stats_t *stats = &thread_stats[omp_get_thread_num()];
+    int t;
+
+    for (l = 0; l <= N_LEVELS; l++)
+    {
+      // same decision in all threads: skipped[l-1] is final after the barrier
+      if ((l > 0) && (skipped[l - 1] > 0))
+        break;
+
+#pragma omp master
+      if (l > 0)
+      {
+        // level l-1 is complete
+        level_ready[l - 1] = omp_get_wtime() - t_start;
+        completed = l;
+        if (display)
+          draw_level(window, level_stride[l - 1], maxiter);
+      }
+
+      if (l < N_LEVELS)
+      {
+        int stride = level_stride[l], coarse = (l > 0) ? level_stride[l - 1] : 0;
+
+#pragma omp for schedule(dynamic)
+        for (t = 0; t < n_tiles_x * n_tiles_y; t++)
+        {
+          int i0 = (t % n_tiles_x) * size_x, j0 = (t / n_tiles_x) * size_y;
+          int i1 = MIN(i0 + size_x, x_resolution), j1 = MIN(j0 + size_y, y_resolution);
+          unsigned long work = 0, pixels = 0, n_cardioid = 0, n_periodicity = 0;
+          double t_tile;
+          int i, j, k, shortcut;
+
+          if (view_changed)
+          {
+#pragma omp atomic
+            skipped[l]++;
+            continue;
+          }
+
+          t_tile = omp_get_wtime();
+          // first multiples of stride in the tile, rows until the view changes
+          for (j = (j0 + stride - 1) / stride * stride; (j < j1) && !view_changed; j += stride)
+            for (i = (i0 + stride - 1) / stride * stride; i < i1; i += stride)
+            {
+              if ((coarse > 0) && (i % coarse == 0) && (j % coarse == 0))
+                continue; // computed on a coarser level
+              if (use_cardioid || use_periodicity)
+              {
+                k = iterate_fast(xmin + i * dx, ymin + j * dy, maxiter, &shortcut);
+                n_cardioid += (shortcut == 1);
+                n_periodicity += (shortcut == 2);
+              }
+              else
+                k = iterate(xmin + i * dx, ymin + j * dy, maxiter);
+              ITERATIONS(i, j) = k;
+              work += k;
+              pixels++;
+            }
+          if (j < j1)
+          {
+            // tile not finished
+#pragma omp atomic
+            skipped[l]++;
+          }
+#pragma omp atomic
+          level_pixels[l] += pixels;
+#pragma omp atomic
+          cardioid_pixels += n_cardioid;
+#pragma omp atomic
+          periodicity_pixels += n_periodicity;
+          stats->pixels += pixels;
+          stats->iterations += work;
+          stats->time += omp_get_wtime() - t_tile;
+          sum += work;
+        }
+      }
+    }
+  }
+
+  timer.it_value.tv_sec = timer.it_value.tv_usec = 0;
+  setitimer(ITIMER_REAL, &timer, NULL);
+  signal(SIGINT, SIG_DFL);
+
+  for (l = 0; l < N_LEVELS; l++)
+    if (l < completed)
+      printf("level 1/%-2d: %9lu pixels computed, ready after %.4f s\n",
+             level_stride[l], level_pixels[l], level_ready[l]);
+    else if (skipped[l] > 0)
+      printf("level 1/%-2d: cancelled by view change, %lu of %d tiles not finished\n",
+             level_stride[l], skipped[l], n_tiles_x * n_tiles_y);
+  progressive_cancelled = (completed < N_LEVELS);
+  checksum += sum;
+}
+
+/*==============================================================================*/
+/* tile cache for exploration
+
+   All views of a zoom level z lie on one grid of pixels with distance
+   dx/2^z, dy/2^z, point (gx,gy) of the grid is xmin + gx dx/2^z etc. with
+   xmin, ymin, dx, dy of the command line. The grid is divided into tiles
+   of CACHE_TILE x CACHE_TILE points, a tile is identified by (zoom, tx, ty,
+   maxiter) and computed with the same kernels as the pixel buffer. A view
+   is copied together from its tiles, so after a pan only the newly exposed
+   tiles are computed.
+
+   The cache is a hash table and a list in the order of use (least
+   recently used at the end), both protected by one lock; the lock is only
+   held for bookkeeping, never while a tile is computed. A tile is pinned
+   while it is computed or copied and not evicted then, so the memory bound
+   may be exceeded by the number of threads. A tile in computation is in
+   the cache already (ready == 0), a second request for it waits. */
+
+typedef struct tile_s
+{
+  int zoom, tx, ty, maxiter;  // key
+  int *iterations;            // CACHE_TILE x CACHE_TILE iteration counts
+  int ready;                  // computation finished
+  int users;                  // pinned while > 0
+  int prefetched;             // computed by prefetch and not used so far
+  struct tile_s *next_hash;   // next tile in hash bucket
+  struct tile_s *prev, *next; // list in order of use
+} tile_t;
+
+// view of -explore: upper left grid point and tiles covered
+typedef struct
+{
+  int zoom, gx, gy;
+  int tx0, tx1, ty0, ty1;
+} view_t;
+
+static omp_lock_t cache_lock;
+static tile_t **cache_table = NULL;
+static int cache_buckets = 0;
+static tile_t *lru_first = NULL, *lru_last = NULL;
+static long cache_tiles = 0, cache_max_tiles = 0;
+static unsigned long cache_hits = 0, cache_prefetch_hits = 0, cache_waits = 0, cache_misses = 0;
+static unsigned long cache_prefetched = 0, cache_evictions = 0, cache_unused = 0;
+static view_t *views = NULL;
+static int n_views = 0, current_view = 0;
+
+// floor(a / b) for b > 0
+static inline int
+floor_div(int a, int b)
+{
+  return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+static inline unsigned
+tile_hash(int zoom, int tx, int ty, int maxiter)
+{
+  return ((unsigned)tx * 73856093u ^ (unsigned)ty * 19349663u ^ (unsigned)zoom * 83492791u ^
+          (unsigned)maxiter * 2654435761u) % cache_buckets;
+}
+
+static void
+lru_unlink(tile_t *t)
+{
+  if (t->prev != NULL)
+    t->prev->next = t->next;
+  else
+    lru_first = t->next;
+  if (t->next != NULL)
+    t->next->prev = t->prev;
+  else
+    lru_last = t->prev;
+}
+
+static void
+lru_push(tile_t *t)
+{
+  t->prev = NULL;
+  t->next = lru_first;
+  if (lru_first != NULL)
+    lru_first->prev = t;
+  else
+    lru_last = t;
+  lru_first = t;
+}
+
+// new tile for the cache, called with the lock held
+static tile_t *
+cache_new_tile()
+{
+  tile_t *t, **p;
+
+  if (cache_tiles >= cache_max_tiles)
+  {
+    // evict least recently used tile that is not pinned
+    for (t = lru_last; (t != NULL) && (t->users > 0); t = t->prev)
+      ;
+    if (t != NULL)
+    {
+      for (p = &cache_table[tile_hash(t->zoom, t->tx, t->ty, t->maxiter)]; *p != t; p = &(*p)->next_hash)
+        ;
+      *p = t->next_hash;
+      lru_unlink(t);
+      cache_evictions++;
+      cache_unused += t->prefetched;
+      return t;
+    }
+  }
+
+  t = malloc(sizeof(*t));
+  if (t != NULL)
+    t->iterations = malloc(CACHE_TILE * CACHE_TILE * sizeof(*t->iterations));
+  if ((t == NULL) || (t->iterations == NULL))
+  {
+    fprintf(stderr, "no more memory\n");
+    exit(EXIT_FAILURE);
+  }
+  cache_tiles++;
+  return t;
+}
+
+/* pinned tile (zoom,tx,ty), computed if it is not in the cache; a prefetch
+   only computes missing tiles and returns NULL otherwise */
+static tile_t *
+cache_get(int zoom, int tx, int ty, int maxiter, double xmin, double ymin, double dx, double dy, int prefetch)
+{
+  unsigned h = tile_hash(zoom, tx, ty, maxiter);
+  thread_stats_t *stats;
+  double t_tile;
+  tile_t *t;
+  int ready;
+
+  omp_set_lock(&cache_lock);
+  for (t = cache_table[h]; t != NULL; t = t->next_hash)
+    if ((t->zoom == zoom) && (t->tx == tx) && (t->ty == ty) && (t->maxiter == maxiter))
+      break;
+
+  if ((t != NULL) && prefetch)
+  {
+    omp_unset_lock(&cache_lock);
+    return NULL;
+  }
+
+  if (t != NULL)
+  {
+    lru_unlink(t);
+    lru_push(t);
+    t->users++;
+    if (!t->ready)
+      cache_waits++;
+    else if (t->prefetched)
+      cache_prefetch_hits++;
+    else
+      cache_hits++;
+    t->prefetched = 0;
+    omp_unset_lock(&cache_lock);
+
+    // in computation by another thread
+    do
+    {
+#pragma omp atomic read
+      ready = t->ready;
+      if (!ready)
+      {
+#pragma omp taskyield
+      }
+    } while (!ready);
+#pragma omp flush
+    return t;
+  }
+
+  // missing: insert pinned and compute outside the lock
+  t = cache_new_tile();
+  t->zoom = zoom;
+  t->tx = tx;
+  t->ty = ty;
+  t->maxiter = maxiter;
+  t->ready = 0;
+  t->users = 1;
+  t->prefetched = prefetch;
+  t->next_hash = cache_table[h];
+  cache_table[h] = t;
+  lru_push(t);
+  if (prefetch)
+    cache_prefetched++;
+  else
+    cache_misses++;
+  omp_unset_lock(&cache_lock);
+
+  stats = &thread_stats[omp_get_thread_num()];
+  t_tile = omp_get_wtime();
+  stats->iterations += BLOCK(t->iterations, CACHE_TILE, tx * CACHE_TILE, (tx + 1) * CACHE_TILE,
+                             ty * CACHE_TILE, (ty + 1) * CACHE_TILE, xmin, ymin, dx, dy, maxiter);
+  stats->pixels += CACHE_TILE * CACHE_TILE;
+  stats->time += omp_get_wtime() - t_tile;
+#pragma omp flush
+#pragma omp atomic write
+  t->ready = 1;
+  return t;
+}
+
+static void
+cache_release(tile_t *t)
+{
+  omp_set_lock(&cache_lock);
+  t->users--;
+  omp_unset_lock(&cache_lock);
+}
+
+// read the views from file
+static void
+read_views(const char *filename, double xmin, double ymin, double dx, double dy)
+{
+  FILE *f = fopen(filename, "r");
+  double cx, cy;
+  int zoom, capacity = 0;
+
+  if (f == NULL)
+  {
+    fprintf(stderr, "can't open view file %s\n", filename);
+    exit(EXIT_FAILURE);
+  }
+  while (fscanf(f, "%lf %lf %d", &cx, &cy, &zoom) == 3)
+  {
+    view_t *w;
+    double scale = (double)(1 << MIN(MAX(zoom, 0), CACHE_MAX_ZOOM));
+
+    if ((zoom < 0) || (zoom > CACHE_MAX_ZOOM))
+    {
+      fprintf(stderr, "zoom level %d not in 0..%d\n", zoom, CACHE_MAX_ZOOM);
+      exit(EXIT_FAILURE);
+    }
+    if (n_views == capacity)
+    {
+      capacity = 2 * capacity + 16;
+      views = realloc(views, capacity * sizeof(*views));
+      if (views == NULL)
+      {
+        fprintf(stderr, "no more memory\n");
+        exit(EXIT_FAILURE);
+      }
+    }
+    w = &views[n_views++];
+    w->zoom = zoom;
+    w->gx = (int)lround((cx - xmin) / dx * scale) - x_resolution / 2;
+    w->gy = (int)lround((cy - ymin) / dy * scale) - y_resolution / 2;
+    w->tx0 = floor_div(w->gx, CACHE_TILE);
+    w->tx1 = floor_div(w->gx + x_resolution - 1, CACHE_TILE);
+    w->ty0 = floor_div(w->gy, CACHE_TILE);
+    w->ty1 = floor_div(w->gy + y_resolution - 1, CACHE_TILE);
+  }
+  fclose(f);
+  if (n_views == 0)
+  {
+    fprintf(stderr, "no views in %s\n", filename);
+    exit(EXIT_FAILURE);
+  }
+}
+
+// copy the part of tile (tx,ty) in view w into the pixel buffer
+static void
+show_tile(const view_t *w, int tx, int ty, int maxiter,
+          double xmin, double ymin, double dx, double dy)
+{
+  tile_t *t = cache_get(w->zoom, tx, ty, maxiter, xmin, ymin, dx, dy, 0);
+  int i0 = MAX(tx * CACHE_TILE, w->gx), i1 = MIN((tx + 1) * CACHE_TILE, w->gx + x_resolution);
+  int j0 = MAX(ty * CACHE_TILE, w->gy), j1 = MIN((ty + 1) * CACHE_TILE, w->gy + y_resolution);
+  int j;
+
+  for (j = j0; j < j1; j++)
+    memcpy(&ITERATIONS(i0 - w->gx, j - w->gy),
+           &t->iterations[(j - ty * CACHE_TILE) * CACHE_TILE + (i0 - tx * CACHE_TILE)],
+           (i1 - i0) * sizeof(*t->iterations));
+  cache_release(t);
+}
+
+// compute tile (tx,ty) of zoom level, if still near the current view
+static void
+prefetch_tile(int zoom, int tx, int ty, int maxiter,
+              double xmin, double ymin, double dx, double dy)
+{
+  const view_t *w;
+  tile_t *t;
+  int v;
+
+#pragma omp atomic read
+  v = current_view;
+  if (v >= n_views)
+    return;
+  w = &views[v];
+  if ((zoom != w->zoom) || (tx < w->tx0 - prefetch_ring) || (tx > w->tx1 + prefetch_ring) ||
+      (ty < w->ty0 - prefetch_ring) || (ty > w->ty1 + prefetch_ring))
+    return; // the view has moved on
+
+  t = cache_get(zoom, tx, ty, maxiter, xmin, ymin, dx, dy, 1);
+  if (t != NULL)
+    cache_release(t);
+}
+
+/* Render the views one after another. The tiles of a view are tasks of a
+   taskgroup, the view is complete at its end. Afterwards the tiles in a
+   ring of prefetch_ring tiles around the view are created as tasks with
+   lower priority outside any taskgroup (priorities are only honored with
+   OMP_MAX_TASK_PRIORITY >= 1): they are computed by the other threads in
+   background while the next view is processed, and dropped if the view
+   has moved away before they are started. */
+
+static void
+calculate_explore(int window, double xmin, double ymin, double dx, double dy, int maxiter)
+{
+  double t_total = omp_get_wtime();
+  unsigned long requests;
+  int v;
+
+  read_views(explore_file, xmin, ymin, dx, dy);
+  cache_max_tiles = MAX(1, (long)(cache_mb * 1024.0 * 1024.0 / (CACHE_TILE * CACHE_TILE * sizeof(int))));
+  cache_buckets = 2 * cache_max_tiles + 1;
+  cache_table = calloc(cache_buckets, sizeof(*cache_table));
+  if (cache_table == NULL)
+  {
+    fprintf(stderr, "no more memory\n");
+    exit(EXIT_FAILURE);
+  }
+  omp_init_lock(&cache_lock);
+
+#pragma omp parallel
+#pragma omp single
+  {
+    for (v = 0; v < n_views; v++)
+    {
+      const view_t *w = &views[v];
+      double scale = (double)(1 << w->zoom), t_view = omp_get_wtime();
+      double dx_z = dx / scale, dy_z = dy / scale;
+      unsigned long hits, prefetch_hits, waits, misses;
+      int tx, ty;
+
+      omp_set_lock(&cache_lock);
+      hits = cache_hits;
+      prefetch_hits = cache_prefetch_hits;
+      waits = cache_waits;
+      misses = cache_misses;
+      omp_unset_lock(&cache_lock);
+
+#pragma omp atomic write
+      current_view = v;
+
+#pragma omp taskgroup
+      {
+        for (ty = w->ty0; ty <= w->ty1; ty++)
+          for (tx = w->tx0; tx <= w->tx1; tx++)
+          {
+#pragma omp task firstprivate(tx, ty) priority(1)
+            show_tile(w, tx, ty, maxiter, xmin, ymin, dx_z, dy_z);
+          }
+      }
+
+      omp_set_lock(&cache_lock);
+      printf("view %4d: zoom %2d, %4d tiles: %4lu hits, %4lu prefetched, %4lu waited, %4lu computed, %.4f s\n",
+             v, w->zoom, (w->tx1 - w->tx0 + 1) * (w->ty1 - w->ty0 + 1), cache_hits - hits,
+             cache_prefetch_hits - prefetch_hits, cache_waits - waits, cache_misses - misses,
+             omp_get_wtime() - t_view);
+      omp_unset_lock(&cache_lock);
+      if (display)
+        draw_buffer(window, maxiter);
+
+      for (ty = w->ty0 - prefetch_ring; ty <= w->ty1 + prefetch_ring; ty++)
+        for (tx = w->tx0 - prefetch_ring; tx <= w->tx1 + prefetch_ring; tx++)
+          if ((tx < w->tx0) || (tx > w->tx1) || (ty < w->ty0) || (ty > w->ty1))
+          {
+#pragma omp task firstprivate(tx, ty) priority(0)
+            prefetch_tile(w->zoom, tx, ty, maxiter, xmin, ymin, dx_z, dy_z);
+          }
+    }
+
+    // prefetch tasks not started yet are dropped, the others are done
+    // at the barrier of single
+#pragma omp atomic write
+    current_view = n_views;
+  }
+
+  requests = cache_hits + cache_prefetch_hits + cache_waits + cache_misses;
+  printf("cache: %lu requests, hit rate %.1f%% (%lu hits, %lu prefetched, %lu waited for prefetch), %lu computed\n",
+         requests, 100.0 * (requests - cache_misses) / requests, cache_hits, cache_prefetch_hits,
+         cache_waits, cache_misses);
+  printf("cache: %ld of %ld tiles (%.1f MB), %lu evictions, %lu tiles prefetched (%lu evicted unused)\n",
+         cache_tiles, cache_max_tiles, cache_tiles * CACHE_TILE * CACHE_TILE * sizeof(int) / (1024.0 * 1024.0),
+         cache_evictions, cache_prefetched, cache_unused);
+  printf("%d views took %.2f s\n", n_views, omp_get_wtime() - t_total);
+
+  omp_destroy_lock(&cache_lock);
+  while (lru_first != NULL)
+  {
+    tile_t *t = lru_first;
+    lru_first = t->next;
+    free(t->iterations);
+    free(t);
+  }
+  free(cache_table);
+  free(views);
+}
+
+/*==============================================================================*/
+/* fixed point numbers with many digits for the reference orbit
+
+   Two's complement with mp_limbs 32 bit limbs, limb[0] is the least
+   significant one, limb[mp_limbs-1] the (signed) integer part. This is
+   enough for the values of the Mandelbrot iteration (|z| < 3). */
+
+#define MP_MAX_LIMBS 64 // up to 2016 fraction bits
+
+typedef struct
+{
+  uint32_t limb[MP_MAX_LIMBS];
+} mp_t;
+
+static int mp_limbs = 4; // limbs used
+
+static void
+mp_add(mp_t *r, const mp_t *a, const mp_t *b)
+{
+  uint64_t carry = 0;
+  int k;
+
+  for (k = 0; k < mp_limbs; k++)
+  {
+    carry += (uint64_t)a->limb[k] + b->limb[k];
+    r->limb[k] = (uint32_t)carry;
+    carry >>= 32;
+  }
+}
+
+static void
+mp_neg(mp_t *r, const mp_t *a)
+{
+  uint64_t carry = 1;
+  int k;
+
+  for (k = 0; k < mp_limbs; k++)
+  {
+    carry += (uint32_t)~a->limb[k];
+    r->limb[k] = (uint32_t)carry;
+    carry >>= 32;
+  }
+}
+
+static void
+mp_sub(mp_t *r, const mp_t *a, const mp_t *b)
+{
+  mp_t t;
+
+  mp_neg(&t, b);
+  mp_add(r, a, &t);
+}
+
+static int
+mp_negative(const mp_t *a)
+{
+  return (a->limb[mp_limbs - 1] & 0x80000000U) != 0;
+}
+
+static void
+mp_mul(mp_t *r, const mp_t *a, const mp_t *b)
+{
+  uint32_t product[2 * MP_MAX_LIMBS];
+  mp_t x = *a, y = *b;
+  int negative = 0, i, j;
+
+  if (mp_negative(&x))
+  {
+    mp_neg(&x, &x);
+    negative = !negative;
+  }
+  if (mp_negative(&y))
+  {
+    mp_neg(&y, &y);
+    negative = !negative;
+  }
+
+  memset(product, 0, 2 * mp_limbs * sizeof(*product));
+  for (i = 0; i < mp_limbs; i++)
+  {
+    uint64_t carry = 0;
+    for (j = 0; j < mp_limbs; j++)
+    {
+      carry += (uint64_t)x.limb[i] * y.limb[j] + product[i + j];
+      product[i + j] = (uint32_t)carry;
+      carry >>= 32;
+    }
+    product[i + mp_limbs] = (uint32_t)carry;
+  }
+
+  // drop the lowest mp_limbs-1 limbs (truncation)
+  for (i = 0; i < mp_limbs; i++)
+    r->limb[i] = product[i + mp_limbs - 1];
+  if (negative)
+    mp_neg(r, r);
+}
+
+// r = a / d for a >= 0
+static void
+mp_div_small(mp_t *r, const mp_t *a, uint32_t d)
+{
+  uint64_t rest = 0;
+  int k;
+
+  for (k = mp_limbs - 1; k >= 0; k--)
+  {
+    rest = (rest << 32) | a->limb[k];
+    r->limb[k] = (uint32_t)(rest / d);
+    rest %= d;
+  }
+}
+
+// decimal number [-]ddd[.ddd], returns 0 if s is no such number
+static int
+mp_from_string(mp_t *r, const char *s)
+{
+  const char *point, *p;
+  int negative = (*s == '-'), integer = 0;
+
+  memset(r, 0, sizeof(*r));
+  if ((*s == '-') || (*s == '+'))
+    s++;
+  point = strchr(s, '.');
+  if (point == NULL)
+    point = s + strlen(s);
+
+  // fraction from the last digit: f = (f + digit) / 10
+  for (p = s + strlen(s) - 1; p > point; p--)
+  {
+    if ((*p < '0') || (*p > '9'))
+      return 0;
+    r->limb[mp_limbs - 1] += *p - '0';
+    mp_div_small(r, r, 10);
+  }
+  for (p = s; p < point; p++)
+  {
+    if ((*p < '0') || (*p > '9'))
+      return 0;
+    integer = 10 * integer + (*p - '0');
+  }
+  if ((p == s) && (*point != '.'))
+    return 0;
+
+  r->limb[mp_limbs - 1] = integer;
+  if (negative)
+    mp_neg(r, r);
+  return 1;
+}
+
+static double
+mp_to_double(const mp_t *a)
+{
+  mp_t x = *a;
+  double v = 0.0;
+  int k;
+
+  if (mp_negative(&x))
+  {
+    mp_neg(&x, &x);
+    return -mp_to_double(&x);
+  }
+  // three limbs are more than the 53 bits of a double
+  for (k = mp_limbs - 1; (k >= 0) && (k >= mp_limbs - 3); k--)
+    v += ldexp((double)x.limb[k], 32 * (k - (mp_limbs - 1)));
+  return v;
+}
+
+/*==============================================================================*/
+/* deep zoom with perturbation theory
+
+   Only the orbit Z_n of the center C is calculated with many digits
+   (reference orbit). A pixel c = C + dc has the orbit z_n = Z_n + d_n with
+     d_{n+1} = 2 Z_n d_n + d_n^2 + dc,
+   where all values are small enough for double. If |z_n| < |d_n|, the
+   reference is a bad approximation (glitch), and at the end of the
+   reference orbit there is none: then d_n = z_n and the pixel continues at
+   Z_0 = 0 (rebasing), which makes the result independent of the quality of
+   the reference point.
+
+   With -series the first iterations are skipped with the approximation
+     d_n = A_n dc + B_n dc^2 + C_n dc^3,
+     A_{n+1} = 2 Z_n A_n + 1, B_{n+1} = 2 Z_n B_n + A_n^2,
+     C_{n+1} = 2 Z_n C_n + 2 A_n B_n,
+   as long as the cubic term is small compared to the pixel distance. */
+
+#define SERIES_TOLERANCE 1e-3 // cubic term / (A_n * pixel distance)
+
+static double *ref_real, *ref_imag; // reference orbit Z_0 ... Z_{ref_length-1}
+static int ref_length;
+
+static void
+reference_orbit(const mp_t *c_real, const mp_t *c_imag, int maxiter)
+{
+  mp_t z_real, z_imag, real2, imag2, cross;
+  double r, i;
+
+  ref_real = malloc((maxiter + 1) * sizeof(*ref_real));
+  ref_imag = malloc((maxiter + 1) * sizeof(*ref_imag));
+  if ((ref_real == NULL) || (ref_imag == NULL))
+  {
+    fprintf(stderr, "no more memory\n");
+    exit(EXIT_FAILURE);
+  }
+
+  memset(&z_real, 0, sizeof(z_real));
+  memset(&z_imag, 0, sizeof(z_imag));
+  for (ref_length = 0; ref_length <= maxiter;)
+  {
+    r = mp_to_double(&z_real);
+    i = mp_to_double(&z_imag);
+    ref_real[ref_length] = r;
+    ref_imag[ref_length] = i;
+    ref_length++;
+    if (r * r + i * i >= 4.0)
+      break;
+
+    // Z = Z^2 + C
+    mp_mul(&real2, &z_real, &z_real);
+    mp_mul(&imag2, &z_imag, &z_imag);
+    mp_mul(&cross, &z_real, &z_imag);
+    mp_sub(&z_real, &real2, &imag2);
+    mp_add(&z_real, &z_real, c_real);
+    mp_add(&z_imag, &cross, &cross);
+    mp_add(&z_imag, &z_imag, c_imag);
+  }
+}
+
+/* number of iterations that can be skipped, and the coefficients */
+static int
+series_approximation(double radius, double distance, double a[2], double b[2], double c[2])
+{
+  double an[2], bn[2], cn[2];
+  int n;
+
+  a[0] = a[1] = b[0] = b[1] = c[0] = c[1] = 0.0;
+  for (n = 0; n < ref_length - 2; n++)
+  {
+    double zr = 2.0 * ref_real[n], zi = 2.0 * ref_imag[n];
+    an[0] = zr * a[0] - zi * a[1] + 1.0;
+    an[1] = zr * a[1] + zi * a[0];
+    bn[0] = zr * b[0] - zi * b[1] + a[0] * a[0] - a[1] * a[1];
+    bn[1] = zr * b[1] + zi * b[0] + 2.0 * a[0] * a[1];
+    cn[0] = zr * c[0] - zi * c[1] + 2.0 * (a[0] * b[0] - a[1] * b[1]);
+    cn[1] = zr * c[1] + zi * c[0] + 2.0 * (a[0] * b[1] + a[1] * b[0]);
+
+    if (!isfinite(cn[0]) || !isfinite(cn[1]) ||
+        (hypot(cn[0], cn[1]) * radius * radius * radius >
+         SERIES_TOLERANCE * hypot(an[0], an[1]) * distance))
+      break;
+    memcpy(a, an, sizeof(an));
+    memcpy(b, bn, sizeof(bn));
+    memcpy(c, cn, sizeof(cn));
+  }
+
+  return n;
+}
+
+static void
+calculate_deepzoom(int maxiter)
+{
+  mp_t c_real, c_imag;
+  double distance = 2.0 * deep_radius / MIN(x_resolution, y_resolution);
+  double a[2], b[2], c[2], t_reference = gettime();
+  unsigned long sum = 0, n_rebases = 0;
+  int skip = 0;
+
+  // 64 bits more than the pixel distance needs
+  mp_limbs = MIN(MP_MAX_LIMBS, 2 + (int)((-log2(distance) + 64) / 32));
+  if (!mp_from_string(&c_real, deep_real) || !mp_from_string(&c_imag, deep_imag))
+  {
+    fprintf(stderr, "wrong center %s %s\n", deep_real, deep_imag);
+    exit(EXIT_FAILURE);
+  }
+  if (distance < 1e-290)
+    fprintf(stderr, "warning: radius too small for double deltas\n");
+
+  reference_orbit(&c_real, &c_imag, maxiter);
+  printf("reference orbit: %d iterations with %d bits took %.2f s\n",
+         ref_length - 1, 32 * (mp_limbs - 1), gettime() - t_reference);
+  if (use_series)
+  {
+    skip = series_approximation(hypot(x_resolution, y_resolution) / 2 * distance, distance, a, b, c);
+    printf("series approximation skips %d iterations\n", skip);
+  }
+
+#pragma omp parallel reduction(+ : sum, n_rebases)
+  {
+    thread_stats_t *stats = &thread_stats[omp_get_thread_num()];
+    double t_thread = omp_get_wtime();
+    int i, j;
+
+#pragma omp for schedule(dynamic) nowait
+    for (i = 0; i < x_resolution; i++)
+    {
+      unsigned long work = 0;
+      for (j = 0; j < y_resolution; j++)
+      {
+        double dc_real = (i - x_resolution / 2) * distance;
+        double dc_imag = (j - y_resolution / 2) * distance;
+        double d_real = 0.0, d_imag = 0.0, z_real, z_imag, temp, absvalue;
+        int k = skip, m = skip;
+
+        if (skip > 0)
+        {
+          // d = a dc + b dc^2 + c dc^3 (Horner)
+          double t_real = c[0] * dc_real - c[1] * dc_imag + b[0];
+          double t_imag = c[0] * dc_imag + c[1] * dc_real + b[1];
+          temp = t_real * dc_real - t_imag * dc_imag + a[0];
+          t_imag = t_real * dc_imag + t_imag * dc_real + a[1];
+          t_real = temp;
+          d_real = t_real * dc_real - t_imag * dc_imag;
+          d_imag = t_real * dc_imag + t_imag * dc_real;
+        }
+
+        do
+        {
+          temp = 2.0 * (ref_real[m] * d_real - ref_imag[m] * d_imag) + d_real * d_real - d_imag * d_imag + dc_real;
+          d_imag = 2.0 * (ref_real[m] * d_imag + ref_imag[m] * d_real) + 2.0 * d_real * d_imag + dc_imag;
+          d_real = temp;
+          m++;
+          k++;
+          z_real = ref_real[m] + d_real;
+          z_imag = ref_imag[m] + d_imag;
+          absvalue = z_real * z_real + z_imag * z_imag;
+
+          if ((absvalue < d_real * d_real + d_imag * d_imag) || (m == ref_length - 1))
+          {
+            // rebase to the begin of the reference orbit
+            d_real = z_real;
+            d_imag = z_imag;
+            m = 0;
+            n_rebases++;
+          }
+        } while (absvalue < 4.0 && k < maxiter);
+
+        ITERATIONS(i, j) = k;
+        work += k;
+      }
+      stats->pixels += y_resolution;
+      stats->iterations += work;
+      sum += work;
+    }
+
+    stats->time += omp_get_wtime() - t_thread;
+  }
+
+  checksum += sum;
+  rebases = n_rebases;
+  printf("rebases: %lu\n", rebases);
+  free(ref_real);
+  free(ref_imag);
+}
+
+/*==============================================================================*/
+/* print the work of every thread */
+
+static void
+print_thread_stats()
+{
+  int n_threads = omp_get_max_threads();
+  double max_iter = 0.0, sum_iter = 0.0, max_time = 0.0, sum_time = 0.0;
+  int i;
+
+  printf("thread      pixels      iterations    time [s]\n");
+  for (i = 0; i < n_threads; i++)
+  {
+    printf("%6d  %10lu  %14lu  %10.4f\n",
+           i, thread_stats[i].pixels, thread_stats[i].iterations, thread_stats[i].time);
+    max_iter = MAX(max_iter, (double)thread_stats[i].iterations);
+    sum_iter += thread_stats[i].iterations;
+    max_time = MAX(max_time, thread_stats[i].time);
+    sum_time += thread_stats[i].time;
+  }
+  printf("imbalance (max/avg): iterations %.3f, time %.3f\n",
+         (sum_iter > 0.0) ? max_iter / (sum_iter / n_threads) : 1.0,
+         (sum_time > 0.0) ? max_time / (sum_time / n_threads) : 1.0);
+}
+
+/*==============================================================================*/
+/* gray value of a point: black inside the set, logarithmic scale outside */
+
+static unsigned char
+gray(int anziter, int maxiter)
+{
+  if (anziter >= maxiter)
+    return 0;
+  return (unsigned char)(255.0 * log(anziter) / log(maxiter));
+}
+
+/*==============================================================================*/
+/* RGB color of a point: black inside the set, polynomial color ramp on the
+   logarithmic scale of gray() outside */
+
+static void
+color(int anziter, int maxiter, unsigned char *rgb)
+{
+  double t = (anziter >= maxiter) ? 0.0 : log(anziter) / log(maxiter);
+
+  rgb[0] = (unsigned char)(255.0 * 9.0 * (1.0 - t) * t * t * t);
+  rgb[1] = (unsigned char)(255.0 * 15.0 * (1.0 - t) * (1.0 - t) * t * t);
+  rgb[2] = (unsigned char)(255.0 * 8.5 * (1.0 - t) * (1.0 - t) * (1.0 - t) * t);
+}
+
+// color image for file names ending with .ppm, otherwise gray
+static int
+is_ppm(const char *filename)
+{
+  size_t n = strlen(filename);
+
+  return (n > 4) && !strcmp(filename + n - 4, ".ppm");
+}
+
+/*==============================================================================*/
+/* write an image of iteration counts as binary PGM or PPM file */
+
+static void
+write_image(const char *filename, const int *image, int maxiter)
+{
+  int channels = is_ppm(filename) ? 3 : 1;
+  unsigned char *row = malloc((size_t)x_resolution * channels);
+  FILE *f = fopen(filename, "wb");
+  int i, j, ok;
+
+  if ((f == NULL) || (row == NULL))
+  {
+    fprintf(stderr, "can't open output file %s\n", filename);
+    if (f != NULL)
+      fclose(f);
+    free(row);
+    return;
+  }
+
+  ok = fprintf(f, "%s\n%d %d\n255\n", (channels == 3) ? "P6" : "P5", x_resolution, y_resolution) > 0;
+  for (j = 0; ok && (j < y_resolution); j++)
+  {
+    const int *line = &image[(size_t)j * x_resolution];
+    for (i = 0; i < x_resolution; i++)
+      if (channels == 3)
+        color(line[i], maxiter, row + 3 * i);
+      else
+        row[i] = gray(line[i], maxiter);
+    ok = fwrite(row, channels, x_resolution, f) == (size_t)x_resolution;
+  }
+  if ((fclose(f) != 0) || !ok)
+    fprintf(stderr, "can't write output file %s\n", filename);
+  free(row);
+}
+
+/*==============================================================================*/
+/* streaming output
+
+   The image is computed in bands of stream_rows rows, the rows of a band
+   with a dynamic schedule. Every thread iterates a row into its own row of
+   iteration counts and converts it at once to gray or RGB values in the
+   band. There are two bands: while the threads compute band b into one of
+   them, the master thread writes band b-1 from the other one and joins the
+   computation of band b afterwards. The barrier at the end of the loop
+   over the rows of band b makes sure that band b-1 is written before its
+   memory is used for band b+1. So the memory needed is two bands and one
+   row per thread, independent of the image height. */
+
+static void
+calculate_stream(double xmin, double ymin, double dx, double dy, int maxiter)
+{
+  int ppm = is_ppm(stream_file);
+  int channels = ppm ? 3 : 1, rows = MIN(stream_rows, y_resolution);
+  int n_bands = (y_resolution + rows - 1) / rows;
+  size_t row_bytes = (size_t)x_resolution * channels;
+  unsigned char *bands[2];
+  unsigned long sum = 0;
+  double t_write = 0.0;
+  FILE *f = fopen(stream_file, "wb");
+  int ok;
+
+  if (f == NULL)
+  {
+    fprintf(stderr, "can't open output file %s\n", stream_file);
+    exit(EXIT_FAILURE);
+  }
+  bands[0] = malloc(rows * row_bytes);
+  bands[1] = malloc(rows * row_bytes);
+  if ((bands[0] == NULL) || (bands[1] == NULL))
+  {
+    fprintf(stderr, "no more memory\n");
+    exit(EXIT_FAILURE);
+  }
+  ok = fprintf(f, "%s\n%d %d\n255\n", ppm ? "P6" : "P5", x_resolution, y_resolution) > 0;
+
+#pragma omp parallel reduction(+ : sum)
+  {
+    thread_stats_t *stats = &thread_stats[omp_get_thread_num()];
+    int *row = malloc(x_resolution * sizeof(*row));
+    int b, i, j;
+
+    if (row == NULL)
+    {
+      fprintf(stderr, "no more memory\n");
+      exit(EXIT_FAILURE);
+    }
+
+    for (b = 0; b <= n_bands; b++)
+    {
+#pragma omp master
+      if ((b > 0) && ok)
+      {
+        // write previous band, no barrier
+        int j0 = (b - 1) * rows, n = MIN(rows, y_resolution - j0);
+        double t = omp_get_wtime();
+        ok = fwrite(bands[(b - 1) % 2], row_bytes, n, f) == (size_t)n;
+        t_write += omp_get_wtime() - t;
+      }
+
+      if (b < n_bands)
+      {
+        unsigned char *band = bands[b % 2];
+        int j0 = b * rows, j1 = MIN(j0 + rows, y_resolution);
+
+#pragma omp for schedule(dynamic)
+        for (j = j0; j < j1; j++)
+        {
+          unsigned char *pixel = band + (j - j0) * row_bytes;
+          double t_row = omp_get_wtime();
+          unsigned long work = BLOCK(row, x_resolution, 0, x_resolution, j, j + 1, xmin, ymin, dx, dy, maxiter);
+
+          for (i = 0; i < x_resolution; i++)
+            if (ppm)
+              color(row[i], maxiter, pixel + 3 * i);
+            else
+              pixel[i] = gray(row[i], maxiter);
+          stats->pixels += x_resolution;
+          stats->iterations += work;
+          stats->time += omp_get_wtime() - t_row;
+          sum += work;
+        }
+      }
+    }
+
+    free(row);
+  }
+
+  if ((fclose(f) != 0) || !ok)
+    fprintf(stderr, "can't write output file %s\n", stream_file);
+  printf("stream: %d bands of %d rows, %.1f MB for bands, writing took %.2f s\n",
+         n_bands, rows, 2.0 * rows * row_bytes / (1024.0 * 1024.0), t_write);
+  free(bands[0]);
+  free(bands[1]);
+  checksum += sum;
+}
+
+/*==============================================================================*/
+/* animation
+
+   Frame k of n shows the view at t = k/(n-1) between the view of the
+   command line and animate_view: width and height change geometrically,
+   the center moves so that it reaches the end center with the zoom.
+
+   The frames are processed in windows of 2 frames per thread, which keeps
+   the memory for the frame buffers bounded. The iterations of a frame are
+   estimated from the last computed frame and the growth from the frame
+   before (neighboring frames of a zoom differ little); the first frame is
+   computed alone. A frame is divided into parts of rows: a cheap frame is
+   one part and computed by one thread (parallel over frames), a frame
+   above 1/ANIMATE_SPLIT of the share of a thread is divided into parts of
+   this size (parallel within the frame). All parts are tasks, created in
+   the order of decreasing estimate (longest first), so the expensive
+   frames do not end up at the end of a window. The task finishing the
+   last part of a frame writes its file. */
+
+typedef struct
+{
+  int *iterations;     // frame buffer
+  double xmin, ymin, dx, dy;
+  double estimate;     // estimated iterations
+  unsigned long total; // iterations, summed up by the parts
+  int number, parts, remaining;
+} frame_t;
+
+// view of frame k
+static void
+frame_view(frame_t *frame, int k, const double start[4])
+{
+  double t = (animate_frames > 1) ? (double)k / (animate_frames - 1) : 0.0;
+  double min[2];
+  int d;
+
+  for (d = 0; d < 2; d++)
+  {
+    double w0 = start[d + 2] - start[d], w1 = animate_view[d + 2] - animate_view[d];
+    double c0 = 0.5 * (start[d] + start[d + 2]), c1 = 0.5 * (animate_view[d] + animate_view[d + 2]);
+    double r = w1 / w0, scale = pow(r, t), c;
+
+    if (fabs(r - 1.0) < 1e-12)
+      c = c0 + (c1 - c0) * t;
+    else
+      c = c0 + (c1 - c0) * (1.0 - scale) / (1.0 - r);
+    min[d] = c - 0.5 * w0 * scale;
+    if (d == 0)
+      frame->dx = w0 * scale / x_resolution;
+    else
+      frame->dy = w0 * scale / y_resolution;
+  }
+  frame->xmin = min[0];
+  frame->ymin = min[1];
+  frame->number = k;
+}
+
+// compute part of a frame, the last part writes the frame
+static void
+render_part(frame_t *frame, int part, int maxiter)
+{
+  thread_stats_t *stats = &thread_stats[omp_get_thread_num()];
+  int j0 = (int)((long)part * y_resolution / frame->parts);
+  int j1 = (int)((long)(part + 1) * y_resolution / frame->parts);
+  double t_part = omp_get_wtime();
+  unsigned long work = BLOCK(&frame->iterations[(size_t)j0 * x_resolution], x_resolution,
+                             0, x_resolution, j0, j1, frame->xmin, frame->ymin, frame->dx, frame->dy, maxiter);
+  int remaining;
+
+  stats->pixels += (unsigned long)x_resolution * (j1 - j0);
+  stats->iterations += work;
+  stats->time += omp_get_wtime() - t_part;
+
+#pragma omp atomic
+  frame->total += work;
+#pragma omp flush
+#pragma omp atomic capture
+  remaining = --frame->remaining;
+  if (remaining == 0)
+  {
+    char filename[FILENAME_MAX];
+#pragma omp flush
+    snprintf(filename, sizeof(filename), animate_pattern, frame->number);
+    write_image(filename, frame->iterations, maxiter);
+  }
+}
+
+static void
+calculate_animation(double xmin, double ymin, double xmax, double ymax, int maxiter)
+{
+  const double start[4] = {xmin, ymin, xmax, ymax};
+  int n_threads = omp_get_max_threads(), window = 2 * n_threads;
+  frame_t *frames = calloc(window, sizeof(*frames));
+  unsigned long *totals = malloc(animate_frames * sizeof(*totals));
+  unsigned long min_total = 0, max_total = 0;
+  double t_start = omp_get_wtime(), error = 0.0;
+  long split = 0, parts = 0;
+  int k, f, n, estimated = 0;
+
+  if ((frames == NULL) || (totals == NULL))
+  {
+    fprintf(stderr, "no more memory\n");
+    exit(EXIT_FAILURE);
+  }
+  for (f = 0; f < window; f++)
+  {
+    frames[f].iterations = malloc((size_t)x_resolution * y_resolution * sizeof(*frames[f].iterations));
+    if (frames[f].iterations == NULL)
+    {
+      fprintf(stderr, "no more memory\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+#pragma omp parallel
+#pragma omp single
+  for (k = 0; k < animate_frames; k += n)
+  {
+    double growth = 1.0, share = 0.0;
+    int order[window];
+
+    // first frame alone, no estimate yet
+    n = (k == 0) ? 1 : MIN(window, animate_frames - k);
+    if (k >= 2)
+      growth = MIN(2.0, MAX(0.5, (double)totals[k - 1] / MAX(1UL, totals[k - 2])));
+
+    // estimates and parts
+    for (f = 0; f < n; f++)
+    {
+      frame_t *frame = &frames[f];
+      frame_view(frame, k + f, start);
+      frame->estimate = (k == 0) ? 1.0 : totals[k - 1] * pow(growth, f + 1);
+      frame->total = 0;
+      share += frame->estimate;
+    }
+    share /= n_threads;
+    for (f = 0; f < n; f++)
+    {
+      frame_t *frame = &frames[f];
+      if (k == 0)
+        frame->parts = MIN(y_resolution, 4 * n_threads);
+      else
+        frame->parts = MIN(y_resolution, MAX(1, (int)ceil(frame->estimate / (share / ANIMATE_SPLIT))));
+      frame->remaining = frame->parts;
+      split += (frame->parts > 1);
+      parts += frame->parts;
+    }
+
+    // longest first
+    for (f = 0; f < n; f++)
+    {
+      int g = f;
+      while ((g > 0) && (frames[order[g - 1]].estimate < frames[f].estimate))
+      {
+        order[g] = order[g - 1];
+        g--;
+      }
+      order[g] = f;
+    }
+
+#pragma omp taskgroup
+    {
+      int p;
+      for (f = 0; f < n; f++)
+        for (p = 0; p < frames[order[f]].parts; p++)
+        {
+#pragma omp task firstprivate(f, p)
+          render_part(&frames[order[f]], p, maxiter);
+        }
+    }
+
+    for (f = 0; f < n; f++)
+    {
+      unsigned long total = frames[f].total;
+      totals[k + f] = total;
+      if (k > 0)
+      {
+        error += fabs(frames[f].estimate - total) / MAX(1UL, total);
+        estimated++;
+      }
+      min_total = ((k == 0) || (total < min_total)) ? total : min_total;
+      max_total = MAX(max_total, total);
+      checksum += total;
+    }
+  }
+
+  printf("animation: %d frames in %.2f s (%.2f frames/s), %d frames in flight\n",
+         animate_frames, omp_get_wtime() - t_start, animate_frames / (omp_get_wtime() - t_start), window);
+  printf("iterations per frame: %lu .. %lu, %ld frames split, %ld parts\n", min_total, max_total, split, parts);
+  if (estimated > 0)
+    printf("cost estimate from previous frames: mean error %.1f%%\n", 100.0 * error / estimated);
+
+  for (f = 0; f < window; f++)
+    free(frames[f].iterations);
+  free(frames);
+  free(totals);
+}
+
+/*==============================================================================*/
+/* the original version: columns are distributed to the threads, every
+   point is drawn at once inside a critical section */
+
+static void
+calculate_columns(int window, double xmin, double ymin, double dx, double dy, int maxiter)
+{
+  int i, j, k;
+  double absvalue, temp;
+  struct
+  {
+    double real, imag;
+  } z, c;
+
+  /* calculate values for every point in complex plane */
+#pragma omp parallel for private(j, k, z, c, temp, absvalue)
+  for (i = 0; i < x_resolution; i++)
+  {
+    for (j = 0; j < y_resolution; j++)
+    {
+      /* map point to window */
+      c.real = xmin + i * dx;
+      c.imag = ymin + j * dy;
+      z.real = z.imag = 0.0;
+      k = 0;
+
+      // do iterations for point i,j
+      do
+      {
+        temp = z.real * z.real - z.imag * z.imag + c.real;
+        z.imag = 2.0 * z.real * z.imag + c.imag;
+        z.real = temp;
+        absvalue = z.real * z.real + z.imag * z.imag;
+        k++;
+      } while (absvalue < 4.0 && k < maxiter);
+
+// draw point i,j
+#pragma omp critical
+      drawPoint(window, i, j, k, maxiter);
+    }
+    if (display)
+    // flush graphic
+#pragma omp critical
+      graphic_flush(window);
+  }
+}
+
+/*==============================================================================*/
+/* main program */
+
+int main(int argc, char **argv)
+{
+  int maxiter;
+  double xmin, ymin, xmax, ymax;
+  double dx, dy;
+  double t_start, t_end;
+  char ch;
+  int window = 0;
+
+  /* initialisation */
+  get_arguments(argc, argv, &xmin, &ymin, &xmax, &ymax, &maxiter, &display);
+
+  if (display)
+    window = graphic_start(x_resolution, y_resolution, argv[0]);
+  dx = (xmax - xmin) / x_resolution;
+  dy = (ymax - ymin) / y_resolution;
+  if (deep_real != NULL)
+    printf("deep zoom at %s%s%si with radius %g\n",
+           deep_real, (deep_imag[0] == '-') ? "" : "+", deep_imag, deep_radius);
+  else
+    printf("display of (%.5f,%.5f)-(%.5f,%.5f) in steps of (%.5f,%.5f)\n",
+           xmin, ymin, xmax, ymax, dx, dy);
+
+#if defined(SIMD_WIDTH)
+  if (use_simd)
+    printf("SIMD kernel: %s, %d pixels at once\n", SIMD_NAME, SIMD_WIDTH);
+#else
+  if (use_simd)
+    printf("no SIMD kernel compiled in (needs AVX2 or AVX-512), using scalar loop\n");
+#endif
+
+  if (use_buffer || (stream_file != NULL) || (animate_frames > 0))
+  {
+    if (use_buffer)
+      iterations = malloc((size_t)x_resolution * y_resolution * sizeof(*iterations));
+    thread_stats = calloc(omp_get_max_threads(), sizeof(*thread_stats));
+    if ((use_buffer && (iterations == NULL)) || (thread_stats == NULL))
+    {
+      fprintf(stderr, "no more memory\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  /* get start time */
+  t_start = gettime();
+
+/*--------------------------------------------------------------------------*/
+
+  if (stream_file != NULL)
+    calculate_stream(xmin, ymin, dx, dy, maxiter);
+  else if (animate_frames > 0)
+    calculate_animation(xmin, ymin, xmax, ymax, maxiter);
+  else if (deep_real != NULL)
+    calculate_deepzoom(maxiter);
+  else if (use_subdivision)
+    calculate_subdivision(xmin, ymin, dx, dy, maxiter);
+  else if (use_progressive)
+    calculate_progressive(window, xmin, ymin, dx, dy, maxiter);
+  else if (explore_file != NULL)
+    calculate_explore(window, xmin, ymin, dx, dy, maxiter);
+  else if (use_buffer)
+    calculate_buffer(xmin, ymin, dx, dy, maxiter);
+  else
+    calculate_columns(window, xmin, ymin, dx, dy, maxiter);
+
+  /*--------------------------------------------------------------------------*/
+  /* get end time */
+  t_end = gettime();
+  printf("calculation took %.2f s\n", t_end - t_start);
+
+  if (use_buffer)
+  {
+    double t_output = gettime();
+    if (display && !use_progressive && (explore_file == NULL))
+      draw_buffer(window, maxiter);
+    if ((output_file != NULL) && progressive_cancelled)
+      printf("image incomplete, %s not written\n", output_file);
+    else if (output_file != NULL)
+      write_image(output_file, iterations, maxiter);
+    if (display || (output_file != NULL))
+      printf("output took %.2f s\n", gettime() - t_output);
+  }
+  if (use_buffer || (stream_file != NULL) || (animate_frames > 0))
+  {
+    if (use_cardioid || use_periodicity)
+      printf("fast path: %lu pixels by cardioid/bulb test, %lu pixels by periodicity (%.1f%%)\n",
+             cardioid_pixels, periodicity_pixels,
+             100.0 * (cardioid_pixels + periodicity_pixels) /
+                 ((double)x_resolution * y_resolution * MAX(1, animate_frames)));
+    if (show_thread_stats)
+      print_thread_stats();
+  }
+  if (progressive_cancelled)
+    printf("no checksum, image incomplete\n");
+  else if (explore_file != NULL)
+    printf("no checksum, %d views\n", n_views);
+  else if (animate_frames > 1)
+    printf("no checksum, %d frames\n", animate_frames);
+  else if (checksum != REFERENCE_CHECKSUM)
     printf("\t!!!!! error: checksum wrong.\n\texpected:%lu, seen: %lu\n", REFERENCE_CHECKSUM, checksum);
   else
     printf("checksum OK: %lu\n", checksum);
@@ -0,0 +1,214 @@
+/*==============================================================================
+
+   Purpose:    binary checkpoint files for the N-body calculation
+
+==============================================================================*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "checkpoint.h"
+
+/*----------------------------------------------------------------------------*/
+/* variables
+
+   The time loop fills the snapshot buffer and hands it over with
+   checkpoint_write(). The writer thread writes it to disk while the time
+   loop continues. As long as a snapshot is pending, no new one can be
+   taken. */
+
+static pthread_t writer;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static int pending = 0; // snapshot waiting to be written
+static int stop = 0;    // writer thread should terminate
+
+static char *file_name;             // checkpoint file
+static long snapshot_n;             // number of bodies in snapshot
+static double *snapshot;            // the snapshot arrays
+static checkpoint_header_t snapshot_header;
+
+static void *map_address = NULL; // file mapped with checkpoint_map()
+static size_t map_size;
+
+/*----------------------------------------------------------------------------*/
+/* write the snapshot into a temporary file and rename it, so there is
+   always a complete checkpoint file */
+
+static void
+write_file()
+{
+  char *tmp_name = malloc(strlen(file_name) + 5);
+  FILE *f;
+  size_t n = CHECKPOINT_ARRAYS * (size_t)snapshot_n;
+
+  if (tmp_name == NULL)
+  {
+    printf("no more memory\n");
+    exit(1);
+  }
+  sprintf(tmp_name, "%s.tmp", file_name);
+
+  f = fopen(tmp_name, "wb");
+  if ((f == NULL) ||
+      (fwrite(&snapshot_header, sizeof(snapshot_header), 1, f) != 1) ||
+      (fwrite(snapshot, sizeof(*snapshot), n, f) != n) ||
+      (fclose(f) != 0) ||
+      (rename(tmp_name, file_name) != 0))
+    printf("error: can't write checkpoint file %s\n", file_name);
+
+  free(tmp_name);
+}
+
+/*----------------------------------------------------------------------------*/
+
+static void *
+writer_thread(void *arg)
+{
+  pthread_mutex_lock(&lock);
+  for (;;)
+  {
+    while (!pending && !stop)
+      pthread_cond_wait(&cond, &lock);
+    if (!pending)
+      break;
+
+    pthread_mutex_unlock(&lock);
+    write_file();
+    pthread_mutex_lock(&lock);
+
+    pending = 0;
+    pthread_cond_broadcast(&cond);
+  }
+  pthread_mutex_unlock(&lock);
+
+  return NULL;
+}
+
+/*----------------------------------------------------------------------------*/
+
+void checkpoint_start(const char *filename, long n_body)
+{
+  file_name = malloc(strlen(filename) + 1);
+  snapshot = malloc(CHECKPOINT_ARRAYS * (size_t)n_body * sizeof(*snapshot));
+  if ((file_name == NULL) || (snapshot == NULL))
+  {
+    printf("no more memory\n");
+    exit(1);
+  }
+  strcpy(file_name, filename);
+  snapshot_n = n_body;
+  pending = stop = 0;
+
+  if (pthread_create(&writer, NULL, writer_thread, NULL) != 0)
+  {
+    printf("error: can't create checkpoint writer thread\n");
+    exit(1);
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+
+double *
+checkpoint_snapshot(int wait)
+{
+  double *buffer = snapshot;
+
+  pthread_mutex_lock(&lock);
+  if (pending && !wait)
+    buffer = NULL;
+  else
+    while (pending)
+      pthread_cond_wait(&cond, &lock);
+  pthread_mutex_unlock(&lock);
+
+  return buffer;
+}
+
+/*----------------------------------------------------------------------------*/
+
+void checkpoint_write(const checkpoint_header_t *header)
+{
+  pthread_mutex_lock(&lock);
+  snapshot_header = *header;
+  memcpy(snapshot_header.magic, CHECKPOINT_MAGIC, sizeof(snapshot_header.magic));
+  snapshot_header.n_body = snapshot_n;
+  pending = 1;
+  pthread_cond_broadcast(&cond);
+  pthread_mutex_unlock(&lock);
+}
+
+/*----------------------------------------------------------------------------*/
+
+void checkpoint_stop()
+{
+  pthread_mutex_lock(&lock);
+  stop = 1;
+  pthread_cond_broadcast(&cond);
+  pthread_mutex_unlock(&lock);
+
+  pthread_join(writer, NULL);
+  free(snapshot);
+  free(file_name);
+}
+
+/*----------------------------------------------------------------------------*/
+
+const double *
+checkpoint_map(const char *filename, checkpoint_header_t *header)
+{
+  struct stat st;
+  int fd;
+
+  fd = open(filename, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+  if ((fstat(fd, &st) != 0) || (st.st_size < (off_t)sizeof(*header)))
+  {
+    close(fd);
+    return NULL;
+  }
+
+  map_size = st.st_size;
+  map_address = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map_address == MAP_FAILED)
+  {
+    map_address = NULL;
+    return NULL;
+  }
+
+  // check header and file size
+  memcpy(header, map_address, sizeof(*header));
+  if ((memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic)) != 0) ||
+      (header->n_body < 1) ||
+      (map_size != sizeof(*header) + CHECKPOINT_ARRAYS * (size_t)header->n_body * sizeof(double)))
+  {
+    checkpoint_unmap();
+    return NULL;
+  }
+
+  return (const double *)((char *)map_address + sizeof(*header));
+}
+
+/*----------------------------------------------------------------------------*/
+
+void checkpoint_unmap()
+{
+  if (map_address != NULL)
+    munmap(map_address, map_size);
+  map_address = NULL;
+}
+
+/*============================================================================*
+ *                             that's all folks                               *
+ *============================================================================*/
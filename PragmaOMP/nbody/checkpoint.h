@@ -0,0 +1,65 @@
+/*==============================================================================
+
+   Purpose:    binary checkpoint files for the N-body calculation
+
+==============================================================================*/
+
+#if !defined(CHECKPOINT_H_INCLUDED)
+#define CHECKPOINT_H_INCLUDED
+
+#include <stdint.h>
+
+/*============================================================================*/
+/* file format
+
+   A checkpoint file is the header followed by CHECKPOINT_ARRAYS arrays of
+   n_body doubles each (in the order of the enum below). The header has a
+   size of 64 bytes, so all arrays are aligned when the file is mapped. */
+
+#define CHECKPOINT_MAGIC "NBODYCP1"
+
+typedef struct
+{
+  char magic[8];          // CHECKPOINT_MAGIC
+  int64_t n_body;         // number of bodies
+  double t;               // simulated time of the state
+  double dt;              // timestep
+  double mass_factor;     // body mass factor
+  double velocity_factor; // body velocity factor
+  double distance_factor; // body distance factor
+  int64_t step;           // number of timesteps done
+} checkpoint_header_t;
+
+enum
+{
+  CHECKPOINT_POSITION_X,
+  CHECKPOINT_POSITION_Y,
+  CHECKPOINT_VELOCITY_X,
+  CHECKPOINT_VELOCITY_Y,
+  CHECKPOINT_MASS,
+  CHECKPOINT_ARRAYS
+};
+
+/*============================================================================*/
+/* functions */
+
+/* start the writer thread for checkpoints of n_body bodies into filename */
+extern void checkpoint_start(const char *filename, long n_body);
+/* snapshot buffer (CHECKPOINT_ARRAYS x n_body doubles) to be filled, NULL if
+   the last checkpoint is still written and wait is 0 */
+extern double *checkpoint_snapshot(int wait);
+/* hand the filled snapshot buffer to the writer thread */
+extern void checkpoint_write(const checkpoint_header_t *header);
+/* wait for the last checkpoint to be written and stop the writer thread */
+extern void checkpoint_stop(void);
+
+/* map a checkpoint file into memory, returns the arrays or NULL on error */
+extern const double *checkpoint_map(const char *filename, checkpoint_header_t *header);
+/* unmap the file mapped with checkpoint_map() */
+extern void checkpoint_unmap(void);
+
+#endif
+
+/*============================================================================*
+ *                             that's all folks                               *
+ *============================================================================*/
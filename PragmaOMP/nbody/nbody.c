@@ -10,12 +10,20 @@
 ==============================================================================*/
 
 #include <math.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
+#include <omp.h>
+
 #include <libFHBRS.h>
 
+#include "checkpoint.h"
+#include "render.h"
+#include "timing.h"
+#include "trajectory.h"
+
 /*----------------------------------------------------------------------------*/
 /* macros */
 
@@ -25,9 +33,13 @@
 #define BODY_VELOCITY_FACTOR 1e4  // default body velocity factor
 #define BODY_DISTANCE_FACTOR 1e12 // default distance factor for positions
 #define EPSILON 1e-5              // bodies must not come as close as this
+#define TRAJECTORY_SLOTS 64       // frames in the trajectory ring buffer
+
+#define PI 3.14159265358979323846
 
 #define SQR(x) ((x) * (x)) // square function as macro
 #define MAX(x, y) (((x) > (y)) ? (x) : (y))
+#define MIN(x, y) (((x) < (y)) ? (x) : (y))
 
 #define CHECKSUM_REFERENCE 6956984643621UL
 
@@ -48,6 +60,7 @@ typedef struct
   vector_t velocity; // velocity vector
   vector_t force;    // force vector
   double mass;       // body mass (in kg)
+  int id;            // body number, stays the same when bodies are reordered
 } body_t;
 
 /*----------------------------------------------------------------------------*/
@@ -61,7 +74,24 @@ static double body_velocity_factor = BODY_VELOCITY_FACTOR;
 static double body_distance_factor = BODY_DISTANCE_FACTOR;
 
 // actual time, start time, end time and time step (default 10 minute time step)
-static double t, t_end = 1e100, dt = 10.0 * 60.0;
+static double t, t_start = 0.0, t_end = 1e100, dt = 10.0 * 60.0;
+
+// write a checkpoint every checkpoint_interval timesteps (0: never)
+static char *checkpoint_file = NULL;
+static long checkpoint_interval = 0;
+static long checkpoints_skipped = 0;
+// restart from this checkpoint file
+static char *restart_file = NULL;
+static long restart_step = 0; // timesteps done before the restart
+// write positions every trajectory_stride timesteps (0: never)
+static char *trajectory_file = NULL;
+static long trajectory_stride = 0;
+// render an image every frame_interval timesteps (0: never)
+static char *frame_file = NULL;
+static long frame_interval = 0;
+static FILE *frame_stream = NULL; // all frames in one file (no % in frame_file)
+static long frames_written = 0;
+static splat_t *frame_splats;     // bodies in screen coordinates
 
 // (default) screen size
 static int size_x = 800;
@@ -70,9 +100,121 @@ static int size_y = 800;
 // remove old positions on screen?
 static int remove_old_positions = 0;
 
+// draw at most display_max bodies on screen (0: all)
+static int display_max = 0;
+
 // bounce on boundaries
 static int bounce = 0;
 
+// force calculation with pairs of rows of equal work (1) or plain triangular loop (0)
+static int balanced_forces = 1;
+// whole time loop in one parallel region
+static int fused = 0;
+// force calculation in single precision (integration stays in double)
+static int use_float = 0;
+// run float and double version and compare both
+static int compare_precision = 0;
+// number of levels for block timesteps (0: one timestep for all bodies)
+static int block_levels = 0;
+// accuracy parameter for the choice of block timesteps
+static double block_eta = 0.05;
+// only bodies closer than cutoff interact (0: all pairs)
+static double cutoff = 0.0;
+// reorder bodies along a Morton curve every morton_interval timesteps (0: never)
+static long morton_interval = 0;
+static long morton_count = 0;
+static double morton_time = 0.0;
+// report pairs closer than encounter_distance every encounter_interval timesteps
+static double encounter_distance = 0.0;
+static long encounter_interval = 0;
+static long long encounters_total = 0;
+// print busy time per thread at the end
+static int show_thread_times = 0;
+// print time per phase at the end, write Chrome trace to trace_file
+static int show_phase_times = 0;
+static char *trace_file = NULL;
+
+// phases of the time loop for the timing
+enum
+{
+  PHASE_SHOW,    // show_bodies()
+  PHASE_FORCES,  // force calculation (with block timesteps: whole step)
+  PHASE_MOVE,    // move bodies (fused loop: sum up forces and move)
+  PHASE_ENERGY,  // energy diagnostics
+  PHASE_REORDER, // Morton reordering
+  PHASE_OUTPUT,  // checkpoints, trajectory, frames, encounters
+  PHASES
+};
+static const char *const phase_names[PHASES] = {"show", "forces", "move", "energy", "reorder", "output"};
+// file with independent systems to calculate instead of one large system
+static char *ensemble_file = NULL;
+
+// initial distribution of the random bodies
+enum
+{
+  DISTRIBUTION_LIBFHBRS, // uniform, sequential random numbers of libFHBRS
+  DISTRIBUTION_UNIFORM,  // uniform, counter based random numbers
+  DISTRIBUTION_PLUMMER,  // Plummer sphere projected onto the plane
+  DISTRIBUTION_DISK      // rotating disk around a central mass
+};
+static int distribution = DISTRIBUTION_LIBFHBRS;
+static uint64_t seed = 0; // seed for the counter based random numbers
+
+// energy and momentum every energy_interval timesteps into a CSV file
+static char *energy_file = NULL;
+static long energy_interval = 0;
+static FILE *energy_stream;
+static double energy_kinetic, momentum_x, momentum_y; // reduction variables
+static double energy_initial;                         // total energy of the first record
+static double energy_error_max;                       // max. relative deviation from it
+static long energy_records;
+static double energy_step_time[2]; // time of steps without [0] / with [1] diagnostics
+static long energy_step_count[2];
+
+// per thread data for the force calculation
+static int n_threads;           // number of OpenMP threads
+static vector_t *thread_forces; // partial forces per thread (n_threads x n_body)
+static double *thread_potential; // potential energy of the pairs of every thread
+
+// single precision copies for the force calculation, scaled with the
+// distance and mass factors so that all values stay in float range
+typedef struct
+{
+  float x;
+  float y;
+} vector_float_t;
+
+static vector_float_t *position_f; // scaled positions
+static float *mass_f;              // scaled masses
+static float epsilon_f;            // EPSILON in scaled units
+static double force_scale = 1.0;   // factor from accumulated to real forces
+static double potential_scale = 1.0; // same for the potential energy
+
+// block timesteps: body i has the step dt / 2^block_level[i]. Times are
+// counted in ticks of the smallest step dt / 2^(block_levels-1).
+static int *block_level;          // timestep level of every body
+static long *block_start;         // begin of the current step of every body (in ticks)
+static vector_t *predicted;       // positions of all bodies at the current tick
+static int *active;               // bodies ending their step at the current tick
+static long long block_forces;    // number of body-body force evaluations
+static long long block_substeps;  // number of ticks with active bodies
+
+// uniform grid of square cells over the bounding box of all bodies;
+// the bodies of cell c are cell_body[cell_start[c]..cell_start[c+1]-1]
+typedef struct
+{
+  double size;     // edge length of a cell
+  double x0, y0;   // lower left corner
+  int nx, ny;      // number of cells in each direction
+  int capacity;    // allocated cells
+  int *cell_start; // first entry of every cell (nx * ny + 1)
+  int *cell_fill;  // next free entry while sorting
+  int *cell_body;  // bodies sorted by cell (n_body)
+  int *body_cell;  // cell of every body (n_body)
+} grid_t;
+
+static grid_t grid;
+
 static int use_solar_system = 0;
 static body_t solar_system[] = {
     // position, velocity, force, mass (kg)
@@ -92,6 +234,119 @@ static body_t solar_system[] = {
 #define SOLAR_LARGE (sizeof(solar_system) / sizeof(body_t))
 #define SOLAR_SMALL 5
 
+/*----------------------------------------------------------------------------*/
+/* counter based random numbers
+
+   The k-th random number of body i is a hash of (seed, i, k) and does not
+   depend on any other body. Bodies can therefore be initialized in any
+   order by any thread and are the same for every number of threads. */
+
+static inline uint64_t
+splitmix64(uint64_t x)
+{
+  x += 0x9e3779b97f4a7c15UL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9UL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebUL;
+  return x ^ (x >> 31);
+}
+
+// k-th random number of body i in [0,1)
+static inline double
+counter_random(long i, int k)
+{
+  uint64_t x = splitmix64(splitmix64(seed ^ (uint64_t)i) + (uint64_t)k);
+
+  return (x >> 11) * (1.0 / 9007199254740992.0); // 53 bits
+}
+
+/*----------------------------------------------------------------------------*/
+/* uniform distribution, same ranges as with the libFHBRS random numbers */
+
+static void
+init_uniform(body_t *b, long i)
+{
+  b->position.x = (1.0 - 2.0 * counter_random(i, 0)) * body_distance_factor;
+  b->position.y = (1.0 - 2.0 * counter_random(i, 1)) * body_distance_factor;
+  b->velocity.x = 2.0 * (0.5 - counter_random(i, 2)) * body_velocity_factor;
+  b->velocity.y = 2.0 * (0.5 - counter_random(i, 3)) * body_velocity_factor;
+  b->mass = counter_random(i, 4) * body_mass_factor;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Plummer sphere with scale radius body_distance_factor/4 (Aarseth, Henon,
+   Wielen 1974), cut at 10 scale radii and projected onto the x-y plane.
+   All bodies have mass body_mass_factor/2. */
+
+static void
+init_plummer(body_t *b, long i)
+{
+  double a = body_distance_factor / 4.0;
+  double m = body_mass_factor / 2.0;
+  double r, v, q, cos_theta, sin_theta, phi;
+  int k;
+
+  // radius from the cumulative mass r^3/(r^2+a^2)^(3/2), 0.985 is r = 10a
+  r = a / sqrt(pow(0.985 * counter_random(i, 0) + 1e-12, -2.0 / 3.0) - 1.0);
+  cos_theta = 1.0 - 2.0 * counter_random(i, 1);
+  sin_theta = sqrt(1.0 - SQR(cos_theta));
+  phi = 2.0 * PI * counter_random(i, 2);
+  b->position.x = r * sin_theta * cos(phi);
+  b->position.y = r * sin_theta * sin(phi);
+
+  // speed as fraction q of the escape speed, g(q) = q^2 (1-q^2)^3.5 by rejection
+  q = 0.0;
+  for (k = 3; k < 3 + 2 * 100; k += 2)
+  {
+    q = counter_random(i, k);
+    if (0.1 * counter_random(i, k + 1) < SQR(q) * pow(1.0 - SQR(q), 3.5))
+      break;
+  }
+  v = q * sqrt(2.0 * G * m * n_body / sqrt(SQR(r) + SQR(a)));
+  cos_theta = 1.0 - 2.0 * counter_random(i, 203);
+  sin_theta = sqrt(1.0 - SQR(cos_theta));
+  phi = 2.0 * PI * counter_random(i, 204);
+  b->velocity.x = v * sin_theta * cos(phi);
+  b->velocity.y = v * sin_theta * sin(phi);
+
+  b->mass = m;
+}
+
+/*----------------------------------------------------------------------------*/
+/* rotating disk of radius body_distance_factor around a central body with
+   the mass of the whole disk. Bodies are uniform in area between 0.1 and 1
+   radius and move on circular orbits with 5% random velocity. */
+
+static void
+init_disk(body_t *b, long i)
+{
+  double m = body_mass_factor / 2.0;
+  double m_central = m * (n_body - 1);
+  double radius = body_distance_factor;
+  double r, phi, v, m_inside;
+
+  if (i == 0)
+  {
+    // central body at rest
+    b->position.x = b->position.y = 0.0;
+    b->velocity.x = b->velocity.y = 0.0;
+    b->mass = m_central;
+    return;
+  }
+
+  r = radius * sqrt(0.01 + 0.99 * counter_random(i, 0));
+  phi = 2.0 * PI * counter_random(i, 1);
+  b->position.x = r * cos(phi);
+  b->position.y = r * sin(phi);
+
+  // circular speed from the central body and the disk mass inside r
+  m_inside = m_central + m * (n_body - 1) * (SQR(r / radius) - 0.01) / 0.99;
+  v = sqrt(G * m_inside / r);
+  b->velocity.x = -v * sin(phi) + 0.05 * v * (1.0 - 2.0 * counter_random(i, 2));
+  b->velocity.y = v * cos(phi) + 0.05 * v * (1.0 - 2.0 * counter_random(i, 3));
+
+  b->mass = m;
+}
+
 /*----------------------------------------------------------------------------*/
 /* initialize bodies */
 
@@ -100,7 +355,46 @@ init()
 {
   int i;
 
-  if (use_solar_system)
+  if (restart_file != NULL)
+  {
+    // continue from a checkpoint
+    checkpoint_header_t header;
+    const double *state = checkpoint_map(restart_file, &header);
+    if (state == NULL)
+    {
+      printf("error: can't read checkpoint file %s\n", restart_file);
+      exit(1);
+    }
+
+    n_body = header.n_body;
+    t_start = header.t;
+    dt = header.dt;
+    body_mass_factor = header.mass_factor;
+    body_velocity_factor = header.velocity_factor;
+    body_distance_factor = header.distance_factor;
+    restart_step = header.step;
+
+    bodies = malloc(n_body * sizeof(*bodies));
+    if (bodies == NULL)
+    {
+      printf("no more memory\n");
+      exit(1);
+    }
+    for (i = 0; i < n_body; i++)
+    {
+      bodies[i].position.x = state[CHECKPOINT_POSITION_X * n_body + i];
+      bodies[i].position.y = state[CHECKPOINT_POSITION_Y * n_body + i];
+      bodies[i].velocity.x = state[CHECKPOINT_VELOCITY_X * n_body + i];
+      bodies[i].velocity.y = state[CHECKPOINT_VELOCITY_Y * n_body + i];
+      bodies[i].force.x = bodies[i].force.y = 0.0;
+      bodies[i].mass = state[CHECKPOINT_MASS * n_body + i];
+    }
+    checkpoint_unmap();
+    printf("restart from %s at t=%.1f s after %ld timesteps (%ld bodies)\n",
+           restart_file, t_start, restart_step, (long)n_body);
+  }
+
+  else if (use_solar_system)
   {
     // large solar system
     n_body = SOLAR_LARGE - 1;
@@ -125,6 +419,34 @@ init()
     }
   }
 
+  else if (distribution != DISTRIBUTION_LIBFHBRS)
+  {
+    double t0 = gettime();
+
+    // allocate memory for bodies
+    bodies = malloc(n_body * sizeof(*bodies));
+    if (bodies == NULL)
+    {
+      printf("no more memory\n");
+      exit(1);
+    }
+
+    // every body only depends on its index, so the threads first touch
+    // the bodies they work on later
+#pragma omp parallel for schedule(static)
+    for (i = 0; i < n_body; i++)
+    {
+      if (distribution == DISTRIBUTION_PLUMMER)
+        init_plummer(&bodies[i], i);
+      else if (distribution == DISTRIBUTION_DISK)
+        init_disk(&bodies[i], i);
+      else
+        init_uniform(&bodies[i], i);
+      bodies[i].force.x = bodies[i].force.y = 0.0;
+    }
+    printf("time init : %.6f\n", gettime() - t0);
+  }
+
   else
   {
     // allocate memory for bodies
@@ -156,271 +478,2202 @@ init()
       bodies[i].mass = rand_standard() * body_mass_factor;
     }
   }
+
+  for (i = 0; i < n_body; i++)
+    bodies[i].id = i;
 }
 
 /*----------------------------------------------------------------------------*/
-/* version using symmetry of forces */
+/* allocate per thread data for the force calculation */
 
 static void
-calculate_forces()
+init_threads()
 {
-  double distance, magnitude, factor, r;
-  vector_t direction;
-  int i, j;
-#pragma omp parallel for private(j, r, magnitude, distance, direction, factor)
-  for (i = 0; i < n_body - 1; i++)
-  {
-    for (j = i + 1; j < n_body; j++)
-    {
-#pragma omp critical(bodies)
-      r = SQR(bodies[i].position.x - bodies[j].position.x) + SQR(bodies[i].position.y - bodies[j].position.y);
-      // avoid numerical instabilities
-      if (r < EPSILON)
-      {
-        // this is not how nature works :-)
-        r += EPSILON;
-      }
-      distance = sqrt(r);
-#pragma omp critical(bodies)
-      magnitude = (G * bodies[i].mass * bodies[j].mass) / (distance * distance);
-
-      factor = magnitude / distance;
-#pragma omp critical(bodies)
-      {
-        direction.x = bodies[j].position.x - bodies[i].position.x;
-        direction.y = bodies[j].position.y - bodies[i].position.y;
+  n_threads = omp_get_max_threads();
 
-        // +force for body i
-        bodies[i].force.x += factor * direction.x;
-        bodies[i].force.y += factor * direction.y;
+  thread_forces = calloc((size_t)n_threads * n_body, sizeof(*thread_forces));
+  thread_potential = calloc(n_threads, sizeof(*thread_potential));
+  if ((thread_forces == NULL) || (thread_potential == NULL))
+  {
+    printf("no more memory\n");
+    exit(1);
+  }
 
-        // -force for body j
-        bodies[j].force.x -= factor * direction.x;
-        bodies[j].force.y -= factor * direction.y;
-      }
+  if (use_float)
+  {
+    position_f = malloc(n_body * sizeof(*position_f));
+    mass_f = malloc(n_body * sizeof(*mass_f));
+    if ((position_f == NULL) || (mass_f == NULL))
+    {
+      printf("no more memory\n");
+      exit(1);
     }
   }
 }
 
 /*----------------------------------------------------------------------------*/
+/* switch force calculation between single and double precision
+
+   With x = L x', m = M m' the force between two bodies is
+   F = (G M^2 / L^2) * m_i' m_j' (x_j' - x_i') / |x_j' - x_i'|^3,
+   so only the constant in front is calculated in double. */
 
 static void
-move_bodies()
+set_precision(int single)
 {
-  vector_t delta_v, delta_p;
   int i;
-#pragma omp parallel for private(delta_v, delta_p)
-  for (i = 0; i < n_body; i++)
-  {
-    // calculate delta_v
-    delta_v.x = bodies[i].force.x / bodies[i].mass * dt;
-    delta_v.y = bodies[i].force.y / bodies[i].mass * dt;
 
-    // calculate delta_p
-    delta_p.x = (bodies[i].velocity.x + delta_v.x / 2.0) * dt;
-    delta_p.y = (bodies[i].velocity.y + delta_v.y / 2.0) * dt;
+  use_float = single;
+  if (use_float)
+  {
+    for (i = 0; i < n_body; i++)
+      mass_f[i] = bodies[i].mass / body_mass_factor;
+    epsilon_f = EPSILON / SQR(body_distance_factor);
+    force_scale = G * SQR(body_mass_factor) / SQR(body_distance_factor);
+    potential_scale = -G * SQR(body_mass_factor) / body_distance_factor;
+  }
+  else
+    force_scale = potential_scale = 1.0;
+}
 
-    // update body velocity and position
-    bodies[i].velocity.x += delta_v.x;
-    bodies[i].velocity.y += delta_v.y;
-    bodies[i].position.x += delta_p.x;
-    bodies[i].position.y += delta_p.y;
+/*----------------------------------------------------------------------------*/
+/* forces between body i and all bodies j > i of the n bodies b,
+   accumulated into force. If energy is set, the potential energy of these
+   pairs is returned (otherwise 0). */
 
-    // reset forces
-    bodies[i].force.x = bodies[i].force.y = 0.0;
+static inline double
+row_forces(const body_t *b, int n, vector_t *force, int i, int energy)
+{
+  double distance, magnitude, factor, r, potential = 0.0;
+  vector_t direction;
+  int j;
 
-    if (bounce)
+  for (j = i + 1; j < n; j++)
+  {
+    r = SQR(b[i].position.x - b[j].position.x) + SQR(b[i].position.y - b[j].position.y);
+    // avoid numerical instabilities
+    if (r < EPSILON)
     {
-      // bounce on boundaries (i.e. it's more like billard)
-      if ((bodies[i].position.x < -body_distance_factor) || (bodies[i].position.x > body_distance_factor))
-        bodies[i].velocity.x = -bodies[i].velocity.x;
-      if ((bodies[i].position.y < -body_distance_factor) || (bodies[i].position.y > body_distance_factor))
-        bodies[i].velocity.y = -bodies[i].velocity.y;
+      // this is not how nature works :-)
+      r += EPSILON;
     }
+    distance = sqrt(r);
+    magnitude = (G * b[i].mass * b[j].mass) / (distance * distance);
+    if (energy)
+      potential -= magnitude * distance;
+
+    factor = magnitude / distance;
+    direction.x = b[j].position.x - b[i].position.x;
+    direction.y = b[j].position.y - b[i].position.y;
+
+    // +force for body i
+    force[i].x += factor * direction.x;
+    force[i].y += factor * direction.y;
+
+    // -force for body j
+    force[j].x -= factor * direction.x;
+    force[j].y -= factor * direction.y;
   }
+
+  return potential;
 }
 
 /*----------------------------------------------------------------------------*/
-// print bodies on screen
+/* single precision version of row_forces() with accumulation in double,
+   forces and potential energy are in scaled units (see set_precision()) */
 
-// map body positions to screen ccordinates
-#define mapx(x) ((1.0 + (x / body_distance_factor)) * (size_x / 2))
-#define mapy(y) ((1.0 + (y / body_distance_factor)) * (size_y / 2))
+static inline double
+row_forces_float(vector_t *force, int i, int energy)
+{
+  float xi = position_f[i].x, yi = position_f[i].y, mi = mass_f[i];
+  float dx, dy, r, factor;
+  double fx = 0.0, fy = 0.0, potential = 0.0;
+  int j;
+
+  for (j = i + 1; j < n_body; j++)
+  {
+    dx = position_f[j].x - xi;
+    dy = position_f[j].y - yi;
+    r = dx * dx + dy * dy;
+    // avoid numerical instabilities
+    if (r < epsilon_f)
+      r += epsilon_f;
+    factor = mi * mass_f[j] / (r * sqrtf(r));
+    if (energy)
+      potential += mi * mass_f[j] / sqrtf(r);
+
+    fx += factor * dx;
+    fy += factor * dy;
+    force[j].x -= factor * dx;
+    force[j].y -= factor * dy;
+  }
+
+  force[i].x += fx;
+  force[i].y += fy;
+
+  return potential;
+}
+
+/*----------------------------------------------------------------------------*/
+/* partial forces of the calling thread (called inside a parallel region)
+
+   Row i of the upper triangle has n-1-i interactions. In the balanced
+   version row i is paired with row n-2-i, so every pair has exactly n-1
+   interactions and a static schedule gives every thread the same work.
+   Every thread accumulates into its own force array, the partial forces
+   are summed up afterwards with sum_forces(). No barrier at the end.
+   If energy is set, the potential energy of the thread's pairs is stored
+   in thread_potential. */
 
 static void
-show_bodies(int window)
+partial_forces(int energy)
 {
+  int tid = omp_get_thread_num();
+  vector_t *force = thread_forces + (size_t)tid * n_body;
+  double t_busy, potential = 0.0;
   int i;
-  static vector_t old_positions[N_BODY];
-  int mx, my;
 
-  if (display)
+  if (use_float)
   {
-    if (remove_old_positions)
+    // scaled single precision copy of the positions
+#pragma omp for schedule(static)
+    for (i = 0; i < n_body; i++)
     {
-      // delete old bodies
+      position_f[i].x = bodies[i].position.x / body_distance_factor;
+      position_f[i].y = bodies[i].position.y / body_distance_factor;
+    }
+  }
 
-      for (i = 0; i < n_body; i++)
-      {
-        // map to screen coordinates
-        mx = mapx(bodies[i].position.x);
-        my = mapy(bodies[i].position.y);
-        graphic_setColor(window, GRAPHIC_WHITE);
-        graphic_drawCircleFilled(window, old_positions[i].x, old_positions[i].y, MAX(1, (bodies[i].mass / body_mass_factor * 4.0)));
+  t_busy = omp_get_wtime();
+  for (i = 0; i < n_body; i++)
+    force[i].x = force[i].y = 0.0;
 
-        old_positions[i].x = mx;
-        old_positions[i].y = my;
+  if (balanced_forces)
+  {
+#pragma omp for schedule(static) nowait
+    for (i = 0; i < n_body / 2; i++)
+    {
+      if (use_float)
+      {
+        potential += row_forces_float(force, i, energy);
+        // for even n the middle row has no partner
+        if (n_body - 2 - i != i)
+          potential += row_forces_float(force, n_body - 2 - i, energy);
+      }
+      else
+      {
+        potential += row_forces(bodies, n_body, force, i, energy);
+        if (n_body - 2 - i != i)
+          potential += row_forces(bodies, n_body, force, n_body - 2 - i, energy);
       }
     }
+  }
+  else
+  {
+#pragma omp for schedule(static) nowait
+    for (i = 0; i < n_body - 1; i++)
+      if (use_float)
+        potential += row_forces_float(force, i, energy);
+      else
+        potential += row_forces(bodies, n_body, force, i, energy);
+  }
 
-    graphic_flush(window);
+  if (energy)
+    thread_potential[tid] = potential * potential_scale;
+  timing_work(PHASE_FORCES, t_busy);
+}
 
-    for (i = 0; i < n_body; i++)
-    {
-      // draw bodies
-      graphic_setColor(window, i % (GRAPHIC_MAX_COLOR - 1) + 1);
-      graphic_drawCircleFilled(window, mapx(bodies[i].position.x), mapy(bodies[i].position.y), MAX(1, (bodies[i].mass / body_mass_factor * 5.0)));
-    }
+/*----------------------------------------------------------------------------*/
+/* sum up partial forces of all threads for body i */
 
-    graphic_flush(window);
+static inline void
+sum_forces(int i)
+{
+  int k;
+
+  for (k = 0; k < n_threads; k++)
+  {
+    bodies[i].force.x += thread_forces[(size_t)k * n_body + i].x;
+    bodies[i].force.y += thread_forces[(size_t)k * n_body + i].y;
   }
+  bodies[i].force.x *= force_scale;
+  bodies[i].force.y *= force_scale;
 }
 
 /*----------------------------------------------------------------------------*/
+/* version using symmetry of forces */
 
 static void
-usage(char *name)
+calculate_forces(int energy)
 {
-  printf("usage: %s\n"
-         "\t[-nodisplay]        don't display anything\n"
-         "\t[-bodies n]         number of bodies (e.g. 20)\n"
-         "\t[-size x y]         screen size (e.g. 800 600)\n"
-         "\t[-velocityfactor v] velocity factor for bodies (e.g. 1e5)\n"
-         "\t[-massfactor m]     mass factor for bodies (e.g. 1e31)\n"
-         "\t[-distancefactor d] distance factor for bodies (e.g. 1e13)\n"
-         "\t[-removeold]        remove old positions on screen\n"
-         "\t[-timesteps n]      number of seconds for delta_t(e.g. 360 (10 minutes))\n"
-         "\t[-t_end t]          end time in seconds(e.g. 3600 (1 hour))\n"
-         "\t[-bounce]           bounce bodies on screen boundaries\n"
-         "\t[solar_system]      use solar system\n"
-         "\t[solar_system2]     use solar system with 5 inner planets only\n"
-         "\t[solar_system3]     use solar system with an approaching new planet\n",
-         name);
-  exit(1);
+  double t_wall = omp_get_wtime();
+  int i;
+#pragma omp parallel
+  {
+    double t_work;
+
+    partial_forces(energy);
+#pragma omp barrier
+    t_work = omp_get_wtime();
+#pragma omp for schedule(static) nowait
+    for (i = 0; i < n_body; i++)
+      sum_forces(i);
+    timing_work(PHASE_FORCES, t_work);
+  }
+  timing_wall(PHASE_FORCES, t_wall);
 }
 
 /*----------------------------------------------------------------------------*/
 
+static inline void
+move_body(int i)
+{
+  vector_t delta_v, delta_p;
+
+  // calculate delta_v
+  delta_v.x = bodies[i].force.x / bodies[i].mass * dt;
+  delta_v.y = bodies[i].force.y / bodies[i].mass * dt;
+
+  // calculate delta_p
+  delta_p.x = (bodies[i].velocity.x + delta_v.x / 2.0) * dt;
+  delta_p.y = (bodies[i].velocity.y + delta_v.y / 2.0) * dt;
+
+  // update body velocity and position
+  bodies[i].velocity.x += delta_v.x;
+  bodies[i].velocity.y += delta_v.y;
+  bodies[i].position.x += delta_p.x;
+  bodies[i].position.y += delta_p.y;
+
+  // reset forces
+  bodies[i].force.x = bodies[i].force.y = 0.0;
+
+  if (bounce)
+  {
+    // bounce on boundaries (i.e. it's more like billard)
+    if ((bodies[i].position.x < -body_distance_factor) || (bodies[i].position.x > body_distance_factor))
+      bodies[i].velocity.x = -bodies[i].velocity.x;
+    if ((bodies[i].position.y < -body_distance_factor) || (bodies[i].position.y > body_distance_factor))
+      bodies[i].velocity.y = -bodies[i].velocity.y;
+  }
+}
+
 static void
-get_options(int argc, char **argv)
+move_bodies()
 {
+  double t_wall = omp_get_wtime();
   int i;
-  float f;
+#pragma omp parallel
+  {
+    double t_work = omp_get_wtime();
+#pragma omp for nowait
+    for (i = 0; i < n_body; i++)
+      move_body(i);
+    timing_work(PHASE_MOVE, t_work);
+  }
+  timing_wall(PHASE_MOVE, t_wall);
+}
 
-  display = 1;
+/*----------------------------------------------------------------------------*/
+/* block hierarchical timesteps
 
-  for (i = 1; i < argc; i++)
+   Every body has its own timestep dt / 2^l with a level l chosen from its
+   acceleration. The state of a body (position, velocity, force) belongs
+   to the begin of its current step; positions in between are predicted
+   with the same constant acceleration that move_body() assumes. At every
+   tick only the bodies ending their step are moved and get new forces,
+   calculated from the predicted positions of all bodies. All steps end at
+   multiples of dt, so at these times all bodies are synchronized. */
+
+#define BLOCK_STEP(level) (1L << (block_levels - 1 - (level)))
+
+/*----------------------------------------------------------------------------*/
+/* force on body i from the predicted positions of all other bodies,
+   returns the squared distance to the nearest body */
+
+static double
+block_force(int i)
+{
+  double distance, magnitude, factor, r, r_min = 1e300;
+  vector_t direction;
+  int j;
+
+  bodies[i].force.x = bodies[i].force.y = 0.0;
+  for (j = 0; j < n_body; j++)
   {
-    if (!strcmp("-nodisplay", argv[i]))
-    {
-      display = 0;
-    }
+    if (j == i)
+      continue;
+    r = SQR(predicted[i].x - predicted[j].x) + SQR(predicted[i].y - predicted[j].y);
+    // avoid numerical instabilities
+    if (r < EPSILON)
+      r += EPSILON;
+    r_min = MIN(r_min, r);
+    distance = sqrt(r);
+    magnitude = (G * bodies[i].mass * bodies[j].mass) / (distance * distance);
+
+    factor = magnitude / distance;
+    direction.x = predicted[j].x - predicted[i].x;
+    direction.y = predicted[j].y - predicted[i].y;
+    bodies[i].force.x += factor * direction.x;
+    bodies[i].force.y += factor * direction.y;
+  }
 
-    else if (!strcmp("-bodies", argv[i]))
-    {
-      // number of bodies
-      if ((++i >= argc) || (sscanf(argv[i], "%d", &n_body) != 1))
-        usage(argv[0]);
-    }
+  return r_min;
+}
 
-    else if (!strcmp("-timesteps", argv[i]))
-    {
-      // timestep
-      if ((++i >= argc) || (sscanf(argv[i], "%f", &f) != 1))
-        usage(argv[0]);
-      dt = f;
-    }
+/*----------------------------------------------------------------------------*/
+/* new timestep level for body i starting a step at tick
 
-    else if (!strcmp("-t_end", argv[i]))
-    {
-      // end time
-      if ((++i >= argc) || (sscanf(argv[i], "%f", &f) != 1))
-        usage(argv[0]);
-      t_end = f;
-    }
+   The step must not exceed block_eta times the free fall time
+   sqrt(r/|a|) towards the nearest body. A larger step than the current one
+   is only possible if tick is a multiple of the larger step. */
 
-    else if (!strcmp("-size", argv[i]))
-    {
-      // size of screen
-      if ((++i >= argc) || (sscanf(argv[i], "%d", &size_x) != 1))
-        usage(argv[0]);
-      if ((++i >= argc) || (sscanf(argv[i], "%d", &size_y) != 1))
-        usage(argv[0]);
-    }
+static int
+block_new_level(int i, double r_min, long tick)
+{
+  double a, dt_max;
+  int level = 0;
+
+  a = sqrt(SQR(bodies[i].force.x) + SQR(bodies[i].force.y)) / bodies[i].mass;
+  if (a > 0.0)
+  {
+    dt_max = block_eta * sqrt(sqrt(r_min) / a);
+    while ((level < block_levels - 1) && (dt / (1L << level) > dt_max))
+      level++;
+  }
+
+  while ((level < block_level[i]) && (tick % BLOCK_STEP(level) != 0))
+    level++;
+
+  return level;
+}
+
+/*----------------------------------------------------------------------------*/
+/* initial forces and timestep levels of all bodies */
+
+static void
+init_blocksteps()
+{
+  int i;
+
+  block_level = calloc(n_body, sizeof(*block_level));
+  block_start = calloc(n_body, sizeof(*block_start));
+  predicted = malloc(n_body * sizeof(*predicted));
+  active = malloc(n_body * sizeof(*active));
+  if ((block_level == NULL) || (block_start == NULL) || (predicted == NULL) || (active == NULL))
+  {
+    printf("no more memory\n");
+    exit(1);
+  }
+
+  for (i = 0; i < n_body; i++)
+    predicted[i] = bodies[i].position;
+
+#pragma omp parallel for schedule(static)
+  for (i = 0; i < n_body; i++)
+  {
+    block_level[i] = block_levels - 1;
+    block_level[i] = block_new_level(i, block_force(i), 0);
+  }
+  block_forces += (long long)n_body * (n_body - 1);
+}
+
+/*----------------------------------------------------------------------------*/
+/* advance all bodies from tick to tick + BLOCK_STEP(0) (i.e. by dt) */
+
+static void
+block_timestep(long tick)
+{
+  long end = tick + BLOCK_STEP(0);
+  double dt_tick = dt / BLOCK_STEP(0);
+  long long n_forces = 0;
+  int n_active, i, k;
+
+  while (tick < end)
+  {
+    // next tick at which a body ends its step
+    long next = end;
+#pragma omp parallel for schedule(static) reduction(min : next)
+    for (i = 0; i < n_body; i++)
+      next = MIN(next, block_start[i] + BLOCK_STEP(block_level[i]));
+    tick = next;
+
+    n_active = 0;
+    for (i = 0; i < n_body; i++)
+      if (block_start[i] + BLOCK_STEP(block_level[i]) == tick)
+        active[n_active++] = i;
+
+#pragma omp parallel
+    {
+      vector_t delta_v;
+      double tau;
+      int j;
+
+      // predict all positions, move active bodies to the end of their step
+#pragma omp for schedule(static)
+      for (j = 0; j < n_body; j++)
+      {
+        tau = (tick - block_start[j]) * dt_tick;
+        delta_v.x = bodies[j].force.x / bodies[j].mass * tau;
+        delta_v.y = bodies[j].force.y / bodies[j].mass * tau;
+        predicted[j].x = bodies[j].position.x + (bodies[j].velocity.x + delta_v.x / 2.0) * tau;
+        predicted[j].y = bodies[j].position.y + (bodies[j].velocity.y + delta_v.y / 2.0) * tau;
+
+        if (block_start[j] + BLOCK_STEP(block_level[j]) == tick)
+        {
+          bodies[j].velocity.x += delta_v.x;
+          bodies[j].velocity.y += delta_v.y;
+          bodies[j].position = predicted[j];
+
+          if (bounce)
+          {
+            if ((bodies[j].position.x < -body_distance_factor) || (bodies[j].position.x > body_distance_factor))
+              bodies[j].velocity.x = -bodies[j].velocity.x;
+            if ((bodies[j].position.y < -body_distance_factor) || (bodies[j].position.y > body_distance_factor))
+              bodies[j].velocity.y = -bodies[j].velocity.y;
+          }
+        }
+      }
+
+      // new forces and timesteps for the active bodies
+#pragma omp for schedule(static)
+      for (k = 0; k < n_active; k++)
+      {
+        j = active[k];
+        block_level[j] = block_new_level(j, block_force(j), tick);
+        block_start[j] = tick;
+      }
+    }
+
+    n_forces += (long long)n_active * (n_body - 1);
+    block_substeps++;
+  }
+
+  block_forces += n_forces;
+}
+
+/*----------------------------------------------------------------------------*/
+/* statistics for block timesteps */
+
+static void
+print_blocksteps()
+{
+  double dt_min = dt / BLOCK_STEP(0);
+  // only the time simulated in this run (t_start > 0 after -restart)
+  double shared = (t - t_start) / dt_min * n_body * ((double)n_body - 1);
+  int l, i, count;
+
+  printf("block timesteps: %d levels, smallest step %.3f s\n"
+         "\tticks with active bodies : %lld\n"
+         "\tforce evaluations        : %lld (%.6e per simulated second)\n"
+         "\twith shared step %.3f s : %.0f (%.1f times more)\n",
+         block_levels, dt_min, block_substeps,
+         block_forces, (t > t_start) ? block_forces / (t - t_start) : 0.0,
+         dt_min, shared, (block_forces > 0) ? shared / block_forces : 0.0);
+  for (l = 0; l < block_levels; l++)
+  {
+    count = 0;
+    for (i = 0; i < n_body; i++)
+      if (block_level[i] == l)
+        count++;
+    printf("\tlevel %2d (dt=%.3f s): %d bodies\n", l, dt / (1L << l), count);
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+/* cell list
+
+   The bounding box of all bodies is divided into square cells with an edge
+   length of at least min_size. Bodies are sorted by cell with a parallel
+   counting sort; inside a cell they are sorted by index, so the order does
+   not depend on the number of threads. All bodies closer than min_size to
+   a body are in its own or one of the 8 neighbouring cells. The number of
+   cells is bounded by a multiple of n_body (larger cells if necessary),
+   so building the grid and searching neighbours is linear in n for
+   bounded densities. build_grid() is called by all threads of a parallel
+   region. */
+
+#define CELLS_PER_BODY 4
+
+static void
+build_grid(double min_size)
+{
+  static double x_min, x_max, y_min, y_max;
+  static int n_cells;
+  int i, cx, cy, c;
+
+#pragma omp single
+  {
+    x_min = x_max = bodies[0].position.x;
+    y_min = y_max = bodies[0].position.y;
+  }
+
+#pragma omp for reduction(min : x_min, y_min) reduction(max : x_max, y_max)
+  for (i = 0; i < n_body; i++)
+  {
+    x_min = MIN(x_min, bodies[i].position.x);
+    x_max = MAX(x_max, bodies[i].position.x);
+    y_min = MIN(y_min, bodies[i].position.y);
+    y_max = MAX(y_max, bodies[i].position.y);
+  }
+
+#pragma omp single
+  {
+    grid.size = min_size;
+    for (;;)
+    {
+      double nx = floor((x_max - x_min) / grid.size) + 1.0;
+      double ny = floor((y_max - y_min) / grid.size) + 1.0;
+      if (nx * ny <= (double)CELLS_PER_BODY * n_body + 16)
+      {
+        grid.nx = nx;
+        grid.ny = ny;
+        break;
+      }
+      grid.size *= 2.0;
+    }
+    grid.x0 = x_min;
+    grid.y0 = y_min;
+    n_cells = grid.nx * grid.ny;
+
+    if (grid.cell_body == NULL)
+    {
+      grid.cell_body = malloc(n_body * sizeof(*grid.cell_body));
+      grid.body_cell = malloc(n_body * sizeof(*grid.body_cell));
+    }
+    if (n_cells > grid.capacity)
+    {
+      grid.capacity = n_cells;
+      free(grid.cell_start);
+      free(grid.cell_fill);
+      grid.cell_start = malloc((n_cells + 1) * sizeof(*grid.cell_start));
+      grid.cell_fill = malloc(n_cells * sizeof(*grid.cell_fill));
+    }
+    if ((grid.cell_body == NULL) || (grid.body_cell == NULL) || (grid.cell_start == NULL) || (grid.cell_fill == NULL))
+    {
+      printf("no more memory\n");
+      exit(1);
+    }
+    memset(grid.cell_start, 0, (n_cells + 1) * sizeof(*grid.cell_start));
+  }
+
+  // count bodies per cell
+#pragma omp for schedule(static)
+  for (i = 0; i < n_body; i++)
+  {
+    cx = MIN(grid.nx - 1, (int)((bodies[i].position.x - grid.x0) / grid.size));
+    cy = MIN(grid.ny - 1, (int)((bodies[i].position.y - grid.y0) / grid.size));
+    grid.body_cell[i] = c = cy * grid.nx + cx;
+#pragma omp atomic
+    grid.cell_start[c + 1]++;
+  }
+
+#pragma omp single
+  for (c = 0; c < n_cells; c++)
+  {
+    grid.cell_start[c + 1] += grid.cell_start[c];
+    grid.cell_fill[c] = grid.cell_start[c];
+  }
+
+  // sort bodies into cells
+#pragma omp for schedule(static)
+  for (i = 0; i < n_body; i++)
+  {
+    int pos;
+#pragma omp atomic capture
+    pos = grid.cell_fill[grid.body_cell[i]]++;
+    grid.cell_body[pos] = i;
+  }
+
+  // order inside a cell by body index (insertion sort, cells are small)
+#pragma omp for schedule(dynamic, 256)
+  for (c = 0; c < n_cells; c++)
+  {
+    int k, l, b;
+    for (k = grid.cell_start[c] + 1; k < grid.cell_start[c + 1]; k++)
+    {
+      b = grid.cell_body[k];
+      for (l = k - 1; (l >= grid.cell_start[c]) && (grid.cell_body[l] > b); l--)
+        grid.cell_body[l + 1] = grid.cell_body[l];
+      grid.cell_body[l + 1] = b;
+    }
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+/* forces only between bodies closer than cutoff, using the cell list.
+   Every body sums up its own force, so no partial forces are necessary. */
+
+static void
+cutoff_forces()
+{
+  double cutoff2 = SQR(cutoff);
+  int i;
+
+#pragma omp parallel
+  {
+    build_grid(cutoff);
+
+#pragma omp for schedule(dynamic, 64)
+    for (i = 0; i < n_body; i++)
+    {
+      double distance, magnitude, factor, r;
+      vector_t direction, force = {0.0, 0.0};
+      int cx = grid.body_cell[i] % grid.nx, cy = grid.body_cell[i] / grid.nx;
+      int x, y, k, j;
+
+      for (y = MAX(0, cy - 1); y <= MIN(grid.ny - 1, cy + 1); y++)
+        for (x = MAX(0, cx - 1); x <= MIN(grid.nx - 1, cx + 1); x++)
+          for (k = grid.cell_start[y * grid.nx + x]; k < grid.cell_start[y * grid.nx + x + 1]; k++)
+          {
+            j = grid.cell_body[k];
+            direction.x = bodies[j].position.x - bodies[i].position.x;
+            direction.y = bodies[j].position.y - bodies[i].position.y;
+            r = SQR(direction.x) + SQR(direction.y);
+            if ((j == i) || (r >= cutoff2))
+              continue;
+            // avoid numerical instabilities
+            if (r < EPSILON)
+              r += EPSILON;
+            distance = sqrt(r);
+            magnitude = (G * bodies[i].mass * bodies[j].mass) / (distance * distance);
+            factor = magnitude / distance;
+            force.x += factor * direction.x;
+            force.y += factor * direction.y;
+          }
+
+      bodies[i].force = force;
+    }
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+/* report all pairs of bodies closer than encounter_distance at time t_now,
+   called by all threads of a parallel region */
+
+static int
+encounter_due(long step)
+{
+  return (encounter_interval > 0) && (step % encounter_interval == 0);
+}
+
+static void
+detect_encounters(double t_now)
+{
+  static double closest;
+  static long count;
+  static int closest_i, closest_j;
+  double distance2 = SQR(encounter_distance), r, my_closest = distance2;
+  int my_i = -1, my_j = -1;
+  int i;
+
+#pragma omp single
+  {
+    closest = distance2;
+    count = 0;
+    closest_i = closest_j = -1;
+  }
+
+  build_grid(encounter_distance);
+
+#pragma omp for schedule(dynamic, 64) reduction(+ : count)
+  for (i = 0; i < n_body; i++)
+  {
+    int cx = grid.body_cell[i] % grid.nx, cy = grid.body_cell[i] / grid.nx;
+    int x, y, k, j;
+
+    for (y = MAX(0, cy - 1); y <= MIN(grid.ny - 1, cy + 1); y++)
+      for (x = MAX(0, cx - 1); x <= MIN(grid.nx - 1, cx + 1); x++)
+        for (k = grid.cell_start[y * grid.nx + x]; k < grid.cell_start[y * grid.nx + x + 1]; k++)
+        {
+          // every pair only once
+          j = grid.cell_body[k];
+          if (j <= i)
+            continue;
+          r = SQR(bodies[j].position.x - bodies[i].position.x) + SQR(bodies[j].position.y - bodies[i].position.y);
+          if (r < distance2)
+          {
+            count++;
+            if ((r < my_closest) || ((r == my_closest) && (i < my_i)))
+            {
+              my_closest = r;
+              my_i = i;
+              my_j = j;
+            }
+          }
+        }
+  }
+
+#pragma omp critical
+  if ((my_i >= 0) && ((my_closest < closest) || ((my_closest == closest) && (my_i < closest_i))))
+  {
+    closest = my_closest;
+    closest_i = my_i;
+    closest_j = my_j;
+  }
+#pragma omp barrier
+
+#pragma omp single
+  {
+    encounters_total += count;
+    if (count > 0)
+      printf("t=%.1f s: %ld pairs closer than %.3e m, closest bodies %d and %d at %.3e m\n",
+             t_now, count, encounter_distance, bodies[closest_i].id, bodies[closest_j].id, sqrt(closest));
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+/* Morton order
+
+   Bodies are sorted along a Z-order curve over their bounding box, so
+   bodies close in space are close in memory. The 32 bit keys (16 bits per
+   coordinate, interleaved) are sorted with a parallel LSD radix sort: in
+   every pass each thread counts the digits of a contiguous part of the
+   keys, and the offsets are assigned in the order (digit, thread), so the
+   sort is stable and the same for any number of threads. */
+
+#define RADIX_BITS 8
+#define RADIX (1 << RADIX_BITS)
+
+// spread the lower 16 bits of v to the even bit positions
+static inline unsigned int
+spread_bits(unsigned int v)
+{
+  v &= 0x0000ffff;
+  v = (v | (v << 8)) & 0x00ff00ff;
+  v = (v | (v << 4)) & 0x0f0f0f0f;
+  v = (v | (v << 2)) & 0x33333333;
+  v = (v | (v << 1)) & 0x55555555;
+  return v;
+}
+
+/*----------------------------------------------------------------------------*/
+/* sort index[] by key[] (both of size n), tmp arrays of size n as buffers,
+   called by all threads of a parallel region */
+
+static void
+radix_sort(int n, unsigned int *key, int *index, unsigned int *key_tmp, int *index_tmp)
+{
+  static int *count;
+  int nt = omp_get_num_threads(), tid = omp_get_thread_num();
+  int lo = (long)n * tid / nt, hi = (long)n * (tid + 1) / nt;
+  int shift;
+
+#pragma omp single
+  {
+    count = malloc((size_t)nt * RADIX * sizeof(*count));
+    if (count == NULL)
+    {
+      printf("no more memory\n");
+      exit(1);
+    }
+  }
+
+  for (shift = 0; shift < 32; shift += RADIX_BITS)
+  {
+    int *c = count + tid * RADIX;
+    unsigned int *ktmp;
+    int *itmp;
+    int i, d;
+
+    memset(c, 0, RADIX * sizeof(*c));
+    for (i = lo; i < hi; i++)
+      c[(key[i] >> shift) & (RADIX - 1)]++;
+#pragma omp barrier
+
+#pragma omp single
+    {
+      int sum = 0, k, tmp;
+      for (d = 0; d < RADIX; d++)
+        for (k = 0; k < nt; k++)
+        {
+          tmp = count[k * RADIX + d];
+          count[k * RADIX + d] = sum;
+          sum += tmp;
+        }
+    }
+
+    for (i = lo; i < hi; i++)
+    {
+      d = c[(key[i] >> shift) & (RADIX - 1)]++;
+      key_tmp[d] = key[i];
+      index_tmp[d] = index[i];
+    }
+#pragma omp barrier
+
+    ktmp = key;
+    key = key_tmp;
+    key_tmp = ktmp;
+    itmp = index;
+    index = index_tmp;
+    index_tmp = itmp;
+  }
+  // even number of passes: the result is in the original arrays
+
+#pragma omp single
+  free(count);
+}
+
+/*----------------------------------------------------------------------------*/
+/* reorder the bodies (and per body data of block timesteps) in Morton order,
+   called by all threads of a parallel region */
+
+static void
+reorder_bodies_team()
+{
+  static body_t *sorted = NULL;
+  static unsigned int *key, *key_tmp;
+  static int *index, *index_tmp;
+  static long *start_tmp = NULL;
+  static double x_min, x_max, y_min, y_max, t0;
+  double sx, sy;
+  int i;
+
+#pragma omp single
+  {
+    t0 = gettime();
+    if (sorted == NULL)
+    {
+      sorted = malloc(n_body * sizeof(*sorted));
+      key = malloc(n_body * sizeof(*key));
+      key_tmp = malloc(n_body * sizeof(*key_tmp));
+      index = malloc(n_body * sizeof(*index));
+      index_tmp = malloc(n_body * sizeof(*index_tmp));
+      if ((sorted == NULL) || (key == NULL) || (key_tmp == NULL) || (index == NULL) || (index_tmp == NULL))
+      {
+        printf("no more memory\n");
+        exit(1);
+      }
+    }
+    if ((block_level != NULL) && (start_tmp == NULL))
+    {
+      start_tmp = malloc(n_body * sizeof(*start_tmp));
+      if (start_tmp == NULL)
+      {
+        printf("no more memory\n");
+        exit(1);
+      }
+    }
+    x_min = x_max = bodies[0].position.x;
+    y_min = y_max = bodies[0].position.y;
+  }
+
+#pragma omp for reduction(min : x_min, y_min) reduction(max : x_max, y_max)
+  for (i = 0; i < n_body; i++)
+  {
+    x_min = MIN(x_min, bodies[i].position.x);
+    x_max = MAX(x_max, bodies[i].position.x);
+    y_min = MIN(y_min, bodies[i].position.y);
+    y_max = MAX(y_max, bodies[i].position.y);
+  }
+  sx = (x_max > x_min) ? 65535.0 / (x_max - x_min) : 0.0;
+  sy = (y_max > y_min) ? 65535.0 / (y_max - y_min) : 0.0;
+
+#pragma omp for
+  for (i = 0; i < n_body; i++)
+  {
+    key[i] = spread_bits((unsigned int)((bodies[i].position.x - x_min) * sx)) |
+             (spread_bits((unsigned int)((bodies[i].position.y - y_min) * sy)) << 1);
+    index[i] = i;
+  }
+
+  radix_sort(n_body, key, index, key_tmp, index_tmp);
+
+#pragma omp for nowait
+  for (i = 0; i < n_body; i++)
+    sorted[i] = bodies[index[i]];
+
+  if (block_level != NULL)
+  {
+    // index_tmp is free now
+#pragma omp for
+    for (i = 0; i < n_body; i++)
+    {
+      index_tmp[i] = block_level[index[i]];
+      start_tmp[i] = block_start[index[i]];
+    }
+#pragma omp for nowait
+    for (i = 0; i < n_body; i++)
+    {
+      block_level[i] = index_tmp[i];
+      block_start[i] = start_tmp[i];
+    }
+  }
+
+  // only the pointer swap is done by one thread
+#pragma omp barrier
+#pragma omp single
+  {
+    body_t *tmp = bodies;
+    bodies = sorted;
+    sorted = tmp;
+
+    // scaled masses of the single precision version
+    set_precision(use_float);
+
+    morton_count++;
+    morton_time += gettime() - t0;
+  }
+}
+
+static void
+reorder_bodies()
+{
+#pragma omp parallel
+  reorder_bodies_team();
+}
+
+/*----------------------------------------------------------------------------*/
+// print bodies on screen
+
+// map body positions to screen ccordinates
+#define mapx(x) ((1.0 + (x / body_distance_factor)) * (size_x / 2))
+#define mapy(y) ((1.0 + (y / body_distance_factor)) * (size_y / 2))
+
+static void
+show_bodies(int window)
+{
+  int i, k;
+  static vector_t *old_positions = NULL;
+  static int stride;
+  int mx, my;
+
+  if (display)
+  {
+    if (old_positions == NULL)
+    {
+      // for many bodies only every stride-th body (by body number) is drawn,
+      // so drawing time does not grow with n and the same bodies are shown
+      stride = ((display_max > 0) && (n_body > display_max)) ? (n_body + display_max - 1) / display_max : 1;
+      if (remove_old_positions)
+      {
+        old_positions = calloc((n_body + stride - 1) / stride, sizeof(*old_positions));
+        if (old_positions == NULL)
+        {
+          printf("no more memory\n");
+          exit(1);
+        }
+      }
+    }
+
+    if (remove_old_positions)
+    {
+      // delete old bodies
+
+      for (i = 0; i < n_body; i++)
+      {
+        if (bodies[i].id % stride != 0)
+          continue;
+        k = bodies[i].id / stride;
+
+        // map to screen coordinates
+        mx = mapx(bodies[i].position.x);
+        my = mapy(bodies[i].position.y);
+        graphic_setColor(window, GRAPHIC_WHITE);
+        graphic_drawCircleFilled(window, old_positions[k].x, old_positions[k].y, MAX(1, (bodies[i].mass / body_mass_factor * 4.0)));
+
+        old_positions[k].x = mx;
+        old_positions[k].y = my;
+      }
+    }
+
+    graphic_flush(window);
+
+    for (i = 0; i < n_body; i++)
+    {
+      if (bodies[i].id % stride != 0)
+        continue;
+
+      // draw bodies
+      graphic_setColor(window, bodies[i].id % (GRAPHIC_MAX_COLOR - 1) + 1);
+      graphic_drawCircleFilled(window, mapx(bodies[i].position.x), mapy(bodies[i].position.y), MAX(1, (bodies[i].mass / body_mass_factor * 5.0)));
+    }
+
+    graphic_flush(window);
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+/* render bodies off-screen and write the image as PPM file. If frame_file
+   contains a printf format (e.g. frame%05d.ppm) every frame gets its own
+   file, otherwise all frames are appended to one stream which can be
+   converted directly, e.g. with ffmpeg -f image2pipe -c:v ppm -i file */
+
+static void
+start_frames()
+{
+  frame_splats = malloc(n_body * sizeof(*frame_splats));
+  if (frame_splats == NULL)
+  {
+    printf("no more memory\n");
+    exit(1);
+  }
+  render_init(size_x, size_y);
+
+  if (strchr(frame_file, '%') == NULL)
+  {
+    frame_stream = fopen(frame_file, "wb");
+    if (frame_stream == NULL)
+    {
+      printf("error: can't open frame file %s\n", frame_file);
+      exit(1);
+    }
+  }
+}
+
+static int
+frame_due(long step)
+{
+  return (frame_interval > 0) && (step % frame_interval == 0);
+}
+
+// render the bodies, called by all threads of a parallel region
+static void
+render_bodies()
+{
+  int i;
+
+#pragma omp for schedule(static)
+  for (i = 0; i < n_body; i++)
+  {
+    frame_splats[i].x = mapx(bodies[i].position.x);
+    frame_splats[i].y = mapy(bodies[i].position.y);
+    frame_splats[i].radius = MAX(1, (bodies[i].mass / body_mass_factor * 5.0));
+    frame_splats[i].color = bodies[i].id;
+  }
+  render_frame_team(n_body, frame_splats);
+}
+
+// write the rendered frame, called by one thread
+static void
+write_frame()
+{
+  char name[1024];
+  FILE *f = frame_stream;
+
+  if (frame_stream == NULL)
+  {
+    snprintf(name, sizeof(name), frame_file, (int)frames_written);
+    f = fopen(name, "wb");
+  }
+  if ((f == NULL) || render_write(f))
+    printf("error: can't write frame %ld\n", frames_written);
+  if ((frame_stream == NULL) && (f != NULL))
+    fclose(f);
+  frames_written++;
+}
+
+static void
+save_frame()
+{
+#pragma omp parallel
+  render_bodies();
+  write_frame();
+}
+
+static void
+end_frames()
+{
+  if (frame_stream != NULL)
+    fclose(frame_stream);
+  frame_stream = NULL;
+  render_end();
+  free(frame_splats);
+  printf("frames: %ld images written to %s\n", frames_written, frame_file);
+}
+
+/*----------------------------------------------------------------------------*/
+
+static void
+usage(char *name)
+{
+  printf("usage: %s\n"
+         "\t[-nodisplay]        don't display anything\n"
+         "\t[-bodies n]         number of bodies (e.g. 20)\n"
+         "\t[-size x y]         screen size (e.g. 800 600)\n"
+         "\t[-velocityfactor v] velocity factor for bodies (e.g. 1e5)\n"
+         "\t[-massfactor m]     mass factor for bodies (e.g. 1e31)\n"
+         "\t[-distancefactor d] distance factor for bodies (e.g. 1e13)\n"
+         "\t[-removeold]        remove old positions on screen\n"
+         "\t[-displaymax m]     draw only every k-th body so that at most m are drawn\n"
+         "\t[-timesteps n]      number of seconds for delta_t(e.g. 360 (10 minutes))\n"
+         "\t[-t_end t]          end time in seconds(e.g. 3600 (1 hour))\n"
+         "\t[-bounce]           bounce bodies on screen boundaries\n"
+         "\t[-unbalanced]       plain triangular force loop (no pairing of rows)\n"
+         "\t[-fused]            whole time loop in one parallel region\n"
+         "\t[-float]            force calculation in single precision\n"
+         "\t[-compareprecision] run with -float and double, compare checksums and times\n"
+         "\t[-blocksteps l]     block timesteps dt/2^k, k < l, chosen per body\n"
+         "\t[-blocketa e]       accuracy parameter for block timesteps (e.g. 0.05)\n"
+         "\t[-checkpoint f k]   write checkpoint file f every k timesteps\n"
+         "\t[-restart f]        continue from checkpoint file f\n"
+         "\t[-trajectory f k]   write positions to trajectory file f every k timesteps\n"
+         "\t[-energy f k]       write energy and momentum every k timesteps to CSV file f\n"
+         "\t[-frames f k]       render PPM image every k timesteps without X11,\n"
+         "\t                    into files f (e.g. frame%%05d.ppm) or one stream f\n"
+         "\t[-cutoff r]         only bodies closer than r (in m) interact (cell list)\n"
+         "\t[-encounters d k]   report pairs closer than d (in m) every k timesteps\n"
+         "\t[-morton k]         reorder bodies along a Morton curve every k timesteps\n"
+         "\t[-distribution d]   initial bodies with counter based random numbers,\n"
+         "\t                    d = uniform, plummer, disk (default: libFHBRS uniform)\n"
+         "\t[-seed s]           seed for -distribution (e.g. 42)\n"
+         "\t[-ensemble f]       calculate all systems listed in file f in parallel\n"
+         "\t[-threadtimes]      print busy time per thread in the force calculation\n"
+         "\t[-phasetimes]       print time per phase and busy/idle time per thread\n"
+         "\t[-trace f]          write Chrome trace (chrome://tracing) of all phases to f\n"
+         "\t[solar_system]      use solar system\n"
+         "\t[solar_system2]     use solar system with 5 inner planets only\n"
+         "\t[solar_system3]     use solar system with an approaching new planet\n",
+         name);
+  exit(1);
+}
+
+/*----------------------------------------------------------------------------*/
+
+static void
+get_options(int argc, char **argv)
+{
+  int i, other_options = 0;
+  float f;
+
+  display = 1;
+
+  for (i = 1; i < argc; i++)
+  {
+    // the ensemble is described in its file only
+    if (strcmp("-ensemble", argv[i]) && strcmp("-nodisplay", argv[i]))
+      other_options++;
+
+    if (!strcmp("-nodisplay", argv[i]))
+    {
+      display = 0;
+    }
+
+    else if (!strcmp("-bodies", argv[i]))
+    {
+      // number of bodies
+      if ((++i >= argc) || (sscanf(argv[i], "%d", &n_body) != 1))
+        usage(argv[0]);
+    }
+
+    else if (!strcmp("-timesteps", argv[i]))
+    {
+      // timestep
+      if ((++i >= argc) || (sscanf(argv[i], "%f", &f) != 1))
+        usage(argv[0]);
+      dt = f;
+    }
+
+    else if (!strcmp("-t_end", argv[i]))
+    {
+      // end time
+      if ((++i >= argc) || (sscanf(argv[i], "%f", &f) != 1))
+        usage(argv[0]);
+      t_end = f;
+    }
+
+    else if (!strcmp("-size", argv[i]))
+    {
+      // size of screen
+      if ((++i >= argc) || (sscanf(argv[i], "%d", &size_x) != 1))
+        usage(argv[0]);
+      if ((++i >= argc) || (sscanf(argv[i], "%d", &size_y) != 1))
+        usage(argv[0]);
+    }
 
     else if (!strcmp("-massfactor", argv[i]))
     {
-      // number of bodies
-      if ((++i >= argc) || (sscanf(argv[i], "%f", &f) != 1))
-        usage(argv[0]);
-      else
-        body_mass_factor = f;
+      // number of bodies
+      if ((++i >= argc) || (sscanf(argv[i], "%f", &f) != 1))
+        usage(argv[0]);
+      else
+        body_mass_factor = f;
+    }
+
+    else if (!strcmp("-velocityfactor", argv[i]))
+    {
+      // number of bodies
+      if ((++i >= argc) || (sscanf(argv[i], "%f", &f) != 1))
+        usage(argv[0]);
+      else
+        body_velocity_factor = f;
+    }
+
+    else if (!strcmp("-distancefactor", argv[i]))
+    {
+      // number of bodies
+      if ((++i >= argc) || (sscanf(argv[i], "%f", &f) != 1))
+        usage(argv[0]);
+      else
+        body_distance_factor = f;
+    }
+
+    else if (!strcmp("-bounce", argv[i]))
+      bounce = 1;
+
+    else if (!strcmp("-unbalanced", argv[i]))
+      balanced_forces = 0;
+
+    else if (!strcmp("-fused", argv[i]))
+      fused = 1;
+
+    else if (!strcmp("-float", argv[i]))
+      use_float = 1;
+
+    else if (!strcmp("-compareprecision", argv[i]))
+      use_float = compare_precision = 1;
+
+    else if (!strcmp("-blocksteps", argv[i]))
+    {
+      // number of timestep levels
+      if ((++i >= argc) || (sscanf(argv[i], "%d", &block_levels) != 1) || (block_levels < 1) || (block_levels > 30))
+        usage(argv[0]);
+    }
+
+    else if (!strcmp("-blocketa", argv[i]))
+    {
+      // accuracy parameter
+      if ((++i >= argc) || (sscanf(argv[i], "%f", &f) != 1))
+        usage(argv[0]);
+      block_eta = f;
+    }
+
+    else if (!strcmp("-checkpoint", argv[i]))
+    {
+      // checkpoint file and interval
+      if (++i >= argc)
+        usage(argv[0]);
+      checkpoint_file = argv[i];
+      if ((++i >= argc) || (sscanf(argv[i], "%ld", &checkpoint_interval) != 1) || (checkpoint_interval < 1))
+        usage(argv[0]);
+    }
+
+    else if (!strcmp("-restart", argv[i]))
+    {
+      // checkpoint file to start from
+      if (++i >= argc)
+        usage(argv[0]);
+      restart_file = argv[i];
+    }
+
+    else if (!strcmp("-trajectory", argv[i]))
+    {
+      // trajectory file and stride
+      if (++i >= argc)
+        usage(argv[0]);
+      trajectory_file = argv[i];
+      if ((++i >= argc) || (sscanf(argv[i], "%ld", &trajectory_stride) != 1) || (trajectory_stride < 1))
+        usage(argv[0]);
+    }
+
+    else if (!strcmp("-energy", argv[i]))
+    {
+      // energy file and interval
+      if (++i >= argc)
+        usage(argv[0]);
+      energy_file = argv[i];
+      if ((++i >= argc) || (sscanf(argv[i], "%ld", &energy_interval) != 1) || (energy_interval < 1))
+        usage(argv[0]);
+    }
+
+    else if (!strcmp("-frames", argv[i]))
+    {
+      // frame file (pattern) and interval
+      if (++i >= argc)
+        usage(argv[0]);
+      frame_file = argv[i];
+      if ((++i >= argc) || (sscanf(argv[i], "%ld", &frame_interval) != 1) || (frame_interval < 1))
+        usage(argv[0]);
+      if (strchr(frame_file, '%') != NULL)
+      {
+        // exactly one conversion %d, optionally with zero padding and width
+        const char *p = strchr(frame_file, '%');
+        p += 1 + strspn(p + 1, "0123456789");
+        if ((*p != 'd') || (strchr(p, '%') != NULL))
+        {
+          printf("error: file name %s for -frames needs one %%d\n", frame_file);
+          exit(1);
+        }
+      }
+    }
+
+    else if (!strcmp("-cutoff", argv[i]))
+    {
+      // cutoff radius
+      if ((++i >= argc) || (sscanf(argv[i], "%f", &f) != 1) || (f <= 0.0))
+        usage(argv[0]);
+      cutoff = f;
+    }
+
+    else if (!strcmp("-encounters", argv[i]))
+    {
+      // encounter distance and interval
+      if ((++i >= argc) || (sscanf(argv[i], "%f", &f) != 1) || (f <= 0.0))
+        usage(argv[0]);
+      encounter_distance = f;
+      if ((++i >= argc) || (sscanf(argv[i], "%ld", &encounter_interval) != 1) || (encounter_interval < 1))
+        usage(argv[0]);
+    }
+
+    else if (!strcmp("-morton", argv[i]))
+    {
+      // reordering interval
+      if ((++i >= argc) || (sscanf(argv[i], "%ld", &morton_interval) != 1) || (morton_interval < 1))
+        usage(argv[0]);
+    }
+
+    else if (!strcmp("-distribution", argv[i]))
+    {
+      // initial distribution of bodies
+      if (++i >= argc)
+        usage(argv[0]);
+      if (!strcmp("uniform", argv[i]))
+        distribution = DISTRIBUTION_UNIFORM;
+      else if (!strcmp("plummer", argv[i]))
+        distribution = DISTRIBUTION_PLUMMER;
+      else if (!strcmp("disk", argv[i]))
+        distribution = DISTRIBUTION_DISK;
+      else
+        usage(argv[0]);
+    }
+
+    else if (!strcmp("-seed", argv[i]))
+    {
+      // seed for counter based random numbers
+      unsigned long s;
+      if ((++i >= argc) || (sscanf(argv[i], "%lu", &s) != 1))
+        usage(argv[0]);
+      seed = s;
+    }
+
+    else if (!strcmp("-ensemble", argv[i]))
+    {
+      // file with system descriptions
+      if (++i >= argc)
+        usage(argv[0]);
+      ensemble_file = argv[i];
+    }
+
+    else if (!strcmp("-threadtimes", argv[i]))
+      show_thread_times = 1;
+
+    else if (!strcmp("-phasetimes", argv[i]))
+      show_phase_times = 1;
+
+    else if (!strcmp("-trace", argv[i]))
+    {
+      // trace file
+      if (++i >= argc)
+        usage(argv[0]);
+      trace_file = argv[i];
+    }
+
+    else if (!strcmp("-removeold", argv[i]))
+      remove_old_positions = 1;
+
+    else if (!strcmp("-displaymax", argv[i]))
+    {
+      // max. number of bodies on screen
+      if ((++i >= argc) || (sscanf(argv[i], "%d", &display_max) != 1) || (display_max < 0))
+        usage(argv[0]);
+    }
+
+    else if (!strcmp("-solar_system", argv[i]))
+      use_solar_system = 1;
+
+    else if (!strcmp("-solar_system2", argv[i]))
+      use_solar_system = 2;
+
+    else if (!strcmp("-solar_system3", argv[i]))
+      use_solar_system = 3;
+
+    else
+      usage(argv[0]);
+  }
+
+  if ((energy_interval > 0) && ((block_levels > 0) || (cutoff > 0.0)))
+  {
+    printf("error: -energy needs the force calculation with all pairs\n");
+    exit(1);
+  }
+  if ((block_levels > 0) && ((cutoff > 0.0) || fused || use_float || !balanced_forces || show_thread_times))
+  {
+    printf("error: -blocksteps does not work with -cutoff, -fused, -float, -compareprecision, -unbalanced\n"
+           "       and -threadtimes\n");
+    exit(1);
+  }
+  if ((cutoff > 0.0) && (fused || use_float || !balanced_forces || show_thread_times))
+  {
+    printf("error: -cutoff does not work with -fused, -float, -compareprecision, -unbalanced and -threadtimes\n");
+    exit(1);
+  }
+  // the second run with double would overwrite the files of the first one
+  if (compare_precision && ((checkpoint_interval > 0) || (trajectory_stride > 0) || (frame_interval > 0) ||
+                            (energy_interval > 0) || (encounter_interval > 0) || show_thread_times ||
+                            (trace_file != NULL)))
+  {
+    printf("error: -compareprecision does not work with -checkpoint, -trajectory, -frames, -energy,\n"
+           "       -encounters, -threadtimes and -trace\n");
+    exit(1);
+  }
+  if ((ensemble_file != NULL) && (other_options > 0))
+  {
+    printf("error: -ensemble does not work with other options (except -nodisplay),\n"
+           "       the systems are described in the ensemble file\n");
+    exit(1);
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+
+static unsigned long
+checksum_of(const body_t *b, int n)
+{
+  unsigned long checksum = 0;
+
+  // initialize bodies
+  for (int i = 0; i < n; i++)
+  {
+    // random position vector
+    checksum += (unsigned long)round(b[i].position.x);
+    checksum += (unsigned long)round(b[i].position.y);
+  }
+
+  return checksum;
+}
+
+static unsigned long
+checksum()
+{
+  return checksum_of(bodies, n_body);
+}
+
+/*----------------------------------------------------------------------------*/
+/* hand a copy of the state at time t_now after step timesteps to the
+   checkpoint writer thread. If the last checkpoint is still being written,
+   this one is skipped instead of waiting, unless wait is set. */
+
+static void
+save_checkpoint(double t_now, long step, int wait)
+{
+  checkpoint_header_t header;
+  double *snapshot = checkpoint_snapshot(wait);
+  int i;
+
+  if (snapshot == NULL)
+  {
+    checkpoints_skipped++;
+    return;
+  }
+
+  // in the order of the body numbers
+  for (i = 0; i < n_body; i++)
+  {
+    snapshot[CHECKPOINT_POSITION_X * n_body + bodies[i].id] = bodies[i].position.x;
+    snapshot[CHECKPOINT_POSITION_Y * n_body + bodies[i].id] = bodies[i].position.y;
+    snapshot[CHECKPOINT_VELOCITY_X * n_body + bodies[i].id] = bodies[i].velocity.x;
+    snapshot[CHECKPOINT_VELOCITY_Y * n_body + bodies[i].id] = bodies[i].velocity.y;
+    snapshot[CHECKPOINT_MASS * n_body + bodies[i].id] = bodies[i].mass;
+  }
+
+  header.t = t_now;
+  header.dt = dt;
+  header.mass_factor = body_mass_factor;
+  header.velocity_factor = body_velocity_factor;
+  header.distance_factor = body_distance_factor;
+  header.step = restart_step + step; // counted from the very first start
+  checkpoint_write(&header);
+}
+
+/*----------------------------------------------------------------------------*/
+/* hand a copy of the positions at time t_now after step timesteps to the
+   trajectory writer thread */
+
+static void
+save_trajectory(double t_now, long step)
+{
+  double *frame = trajectory_slot();
+  int i;
+
+  // in the order of the body numbers
+  for (i = 0; i < n_body; i++)
+  {
+    frame[bodies[i].id] = bodies[i].position.x;
+    frame[n_body + bodies[i].id] = bodies[i].position.y;
+  }
+  trajectory_push(step, t_now);
+}
+
+/*----------------------------------------------------------------------------*/
+/* energy and momentum diagnostics
+
+   The potential energy is summed up in the pair loop of the force
+   calculation (thread_potential), kinetic energy and momentum with a
+   reduction over the bodies before they are moved, so all values belong to
+   the same time. */
+
+static int
+energy_due(long step)
+{
+  return (energy_interval > 0) && (step % energy_interval == 0);
+}
+
+static void
+start_energy()
+{
+  energy_stream = fopen(energy_file, "w");
+  if (energy_stream == NULL)
+  {
+    printf("error: can't open energy file %s\n", energy_file);
+    exit(1);
+  }
+  fprintf(energy_stream, "step,t,kinetic,potential,total,momentum_x,momentum_y,relative_error\n");
+  energy_kinetic = momentum_x = momentum_y = 0.0;
+  energy_error_max = 0.0;
+  energy_records = 0;
+  energy_step_time[0] = energy_step_time[1] = 0.0;
+  energy_step_count[0] = energy_step_count[1] = 0;
+}
+
+// kinetic energy and momentum (called inside a parallel region)
+static void
+kinetic_energy()
+{
+  int i;
+#pragma omp for schedule(static) reduction(+ : energy_kinetic, momentum_x, momentum_y)
+  for (i = 0; i < n_body; i++)
+  {
+    energy_kinetic += 0.5 * bodies[i].mass * (SQR(bodies[i].velocity.x) + SQR(bodies[i].velocity.y));
+    momentum_x += bodies[i].mass * bodies[i].velocity.x;
+    momentum_y += bodies[i].mass * bodies[i].velocity.y;
+  }
+}
+
+// write one record for time t_now after step timesteps (one thread only)
+static void
+write_energy(double t_now, long step)
+{
+  double potential = 0.0, total, error = 0.0;
+  int k;
+
+  for (k = 0; k < n_threads; k++)
+    potential += thread_potential[k];
+  total = energy_kinetic + potential;
+
+  if (energy_records++ == 0)
+    energy_initial = total;
+  else if (energy_initial != 0.0)
+    error = fabs((total - energy_initial) / energy_initial);
+  energy_error_max = MAX(energy_error_max, error);
+
+  fprintf(energy_stream, "%ld,%.1f,%.10e,%.10e,%.10e,%.10e,%.10e,%.3e\n",
+          step, t_now, energy_kinetic, potential, total, momentum_x, momentum_y, error);
+  energy_kinetic = momentum_x = momentum_y = 0.0;
+}
+
+// account the time of one timestep with or without diagnostics
+static void
+energy_step(int diagnostics, double t_step)
+{
+  if (energy_interval > 0)
+  {
+    energy_step_time[diagnostics] += omp_get_wtime() - t_step;
+    energy_step_count[diagnostics]++;
+  }
+}
+
+static void
+end_energy()
+{
+  double plain, with, overhead = 0.0;
+
+  if (fclose(energy_stream) != 0)
+    printf("error: can't write energy file %s\n", energy_file);
+
+  // overhead = extra time of the diagnostic steps compared to plain steps
+  plain = (energy_step_count[0] > 0) ? energy_step_time[0] / energy_step_count[0] : 0.0;
+  with = (energy_step_count[1] > 0) ? energy_step_time[1] / energy_step_count[1] : 0.0;
+  if ((plain > 0.0) && (energy_step_count[1] > 0))
+    overhead = 100.0 * (with - plain) * energy_step_count[1] / (energy_step_time[0] + energy_step_time[1]);
+  printf("energy diagnostics: %ld records written to %s, max. relative energy error %.3e\n",
+         energy_records, energy_file, energy_error_max);
+  if (energy_step_count[0] > 0)
+    printf("energy diagnostics: step time %.6f s with, %.6f s without, overhead %.2f%% of step time\n",
+           with, plain, overhead);
+  else
+    printf("energy diagnostics: step time %.6f s (no steps without diagnostics to compare)\n", with);
+}
+
+/*----------------------------------------------------------------------------*/
+/* output after step timesteps (same decision in all threads) */
+
+static int
+output_due(long step)
+{
+  return ((checkpoint_interval > 0) && (step % checkpoint_interval == 0)) ||
+         ((trajectory_stride > 0) && (step % trajectory_stride == 0)) ||
+         ((frame_interval > 0) && (step % frame_interval == 0)) ||
+         encounter_due(step);
+}
+
+static void
+output(double t_now, long step)
+{
+  if ((checkpoint_interval > 0) && (step % checkpoint_interval == 0))
+    save_checkpoint(t_now, step, 0);
+  if ((trajectory_stride > 0) && (step % trajectory_stride == 0))
+    save_trajectory(t_now, step);
+  if (frame_due(step))
+    write_frame(); // rendered by the caller
+  // encounters are detected by the caller
+}
+
+/*----------------------------------------------------------------------------*/
+/* phases of the time loop outside of parallel regions with timing */
+
+static void
+timed_reorder(long step)
+{
+  double t_phase;
+
+  if ((morton_interval > 0) && (step % morton_interval == 0))
+  {
+    t_phase = omp_get_wtime();
+    reorder_bodies();
+    timing_wall(PHASE_REORDER, t_phase);
+  }
+}
+
+static void
+timed_show(int window)
+{
+  double t_phase = omp_get_wtime();
+
+  show_bodies(window);
+  timing_wall(PHASE_SHOW, t_phase);
+  timing_work(PHASE_SHOW, t_phase);
+}
+
+static void
+timed_output(double t_now, long step)
+{
+  double t_phase;
+
+  if (output_due(step))
+  {
+    t_phase = omp_get_wtime();
+    if (frame_due(step) || encounter_due(step))
+    {
+#pragma omp parallel
+      {
+        if (frame_due(step))
+          render_bodies();
+        if (encounter_due(step))
+          detect_encounters(t_now);
+      }
     }
+    output(t_now, step);
+    timing_wall(PHASE_OUTPUT, t_phase);
+    timing_work(PHASE_OUTPUT, t_phase);
+  }
+}
 
-    else if (!strcmp("-velocityfactor", argv[i]))
+/*----------------------------------------------------------------------------*/
+/* time loop inside one parallel region
+
+   Instead of a fork/join for calculate_forces() and move_bodies() in every
+   timestep, the team is created once. Summing up the forces and moving a
+   body is done in one loop: both use the same static distribution, so
+   every thread moves exactly the bodies it has summed up. Two barriers per
+   timestep remain: positions must be complete before the next forces are
+   calculated, and partial forces must be complete before they are summed. */
+
+static void
+time_loop_fused(int window)
+{
+  int i;
+#pragma omp parallel private(i)
+  {
+    double t_local, t_step, t_phase, t_work;
+    long step = 0;
+    int diagnostics;
+
+    // wall times are measured by the master thread, work times by all
+    for (t_local = t_start; t_local < t_end; t_local += dt)
     {
-      // number of bodies
-      if ((++i >= argc) || (sscanf(argv[i], "%f", &f) != 1))
-        usage(argv[0]);
-      else
-        body_velocity_factor = f;
+      diagnostics = energy_due(step);
+
+      if ((morton_interval > 0) && (step % morton_interval == 0))
+      {
+        t_phase = omp_get_wtime();
+        reorder_bodies_team();
+#pragma omp master
+        timing_wall(PHASE_REORDER, t_phase);
+      }
+
+      // draw bodies
+      if (display)
+      {
+        t_phase = omp_get_wtime();
+#pragma omp single
+        {
+          show_bodies(window);
+          timing_work(PHASE_SHOW, t_phase);
+        }
+#pragma omp master
+        timing_wall(PHASE_SHOW, t_phase);
+      }
+
+      // computation
+      t_step = t_phase = omp_get_wtime();
+      if (diagnostics)
+      {
+        kinetic_energy();
+#pragma omp master
+        {
+          timing_wall(PHASE_ENERGY, t_phase);
+          t_phase = omp_get_wtime();
+        }
+      }
+      partial_forces(diagnostics);
+#pragma omp barrier
+#pragma omp master
+      {
+        timing_wall(PHASE_FORCES, t_phase);
+        t_phase = omp_get_wtime();
+      }
+      t_work = omp_get_wtime();
+#pragma omp for schedule(static) nowait
+      for (i = 0; i < n_body; i++)
+      {
+        sum_forces(i);
+        move_body(i);
+      }
+      timing_work(PHASE_MOVE, t_work);
+#pragma omp barrier
+#pragma omp master
+      timing_wall(PHASE_MOVE, t_phase);
+      if (diagnostics)
+      {
+        t_phase = omp_get_wtime();
+#pragma omp single
+        write_energy(t_local, step);
+#pragma omp master
+        timing_wall(PHASE_ENERGY, t_phase);
+      }
+#pragma omp master
+      energy_step(diagnostics, t_step);
+
+      if (output_due(++step))
+      {
+        t_phase = omp_get_wtime();
+        if (frame_due(step))
+        {
+          // render with the whole team, not nested in the single
+          render_bodies();
+          timing_work(PHASE_OUTPUT, t_phase);
+        }
+        if (encounter_due(step))
+        {
+          t_work = omp_get_wtime();
+          detect_encounters(t_local + dt);
+          timing_work(PHASE_OUTPUT, t_work);
+        }
+#pragma omp single
+        {
+          t_work = omp_get_wtime();
+          output(t_local + dt, step);
+          timing_work(PHASE_OUTPUT, t_work);
+        }
+#pragma omp master
+        timing_wall(PHASE_OUTPUT, t_phase);
+      }
     }
 
-    else if (!strcmp("-distancefactor", argv[i]))
+#pragma omp single
+    t = t_local;
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+/* run the time loop from t_start to t_end, returns the elapsed time */
+
+static double
+time_loop(int window)
+{
+  double t0 = gettime();
+  long tick = 0, step = 0;
+
+  if (checkpoint_interval > 0)
+    checkpoint_start(checkpoint_file, n_body);
+  if (trajectory_stride > 0)
+  {
+    trajectory_header_t header = {0};
+    header.n_body = n_body;
+    header.stride = trajectory_stride;
+    header.dt = dt;
+    header.distance_factor = body_distance_factor;
+    trajectory_start(trajectory_file, &header, TRAJECTORY_SLOTS);
+    save_trajectory(t_start, 0);
+  }
+  if (frame_interval > 0)
+  {
+    start_frames();
+    save_frame();
+  }
+  if (energy_interval > 0)
+    start_energy();
+
+  if (block_levels > 0)
+  {
+    init_blocksteps();
+    for (t = t_start; t < t_end; t += dt, tick += BLOCK_STEP(0))
     {
-      // number of bodies
-      if ((++i >= argc) || (sscanf(argv[i], "%f", &f) != 1))
-        usage(argv[0]);
-      else
-        body_distance_factor = f;
+      double t_phase;
+
+      timed_reorder(step);
+
+      // draw bodies
+      timed_show(window);
+
+      // computation (all phases of a block timestep)
+      t_phase = omp_get_wtime();
+      block_timestep(tick);
+      timing_wall(PHASE_FORCES, t_phase);
+
+      timed_output(t + dt, ++step);
     }
+  }
+  else if (cutoff > 0.0)
+    for (t = t_start; t < t_end; t += dt)
+    {
+      double t_phase;
 
-    else if (!strcmp("-bounce", argv[i]))
-      bounce = 1;
+      timed_reorder(step);
 
-    else if (!strcmp("-removeold", argv[i]))
-      remove_old_positions = 1;
+      // draw bodies
+      timed_show(window);
 
-    else if (!strcmp("-solar_system", argv[i]))
-      use_solar_system = 1;
+      // computation
+      t_phase = omp_get_wtime();
+      cutoff_forces();
+      timing_wall(PHASE_FORCES, t_phase);
+      move_bodies();
 
-    else if (!strcmp("-solar_system2", argv[i]))
-      use_solar_system = 2;
+      timed_output(t + dt, ++step);
+    }
+  else if (fused)
+    time_loop_fused(window);
+  else
+    for (t = t_start; t < t_end; t += dt)
+    {
+      double t_step, t_phase;
+      int diagnostics = energy_due(step);
 
-    else if (!strcmp("-solar_system3", argv[i]))
-      use_solar_system = 3;
+      timed_reorder(step);
 
-    else
-      usage(argv[0]);
+      // draw bodies
+      timed_show(window);
+
+      // computation
+      t_step = omp_get_wtime();
+      calculate_forces(diagnostics);
+      if (diagnostics)
+      {
+        t_phase = omp_get_wtime();
+#pragma omp parallel
+        kinetic_energy();
+        write_energy(t, step);
+        timing_wall(PHASE_ENERGY, t_phase);
+      }
+      move_bodies();
+      energy_step(diagnostics, t_step);
+
+      timed_output(t + dt, ++step);
+    }
+
+  if (checkpoint_interval > 0)
+  {
+    // final state (waits for the writer thread)
+    save_checkpoint(t, (long)ceil((t - t_start) / dt), 1);
+    checkpoint_stop();
   }
+  if (trajectory_stride > 0)
+  {
+    long frames, stalls = trajectory_stalls();
+    frames = trajectory_stop();
+    printf("trajectory: %ld frames written to %s, time loop waited %ld times for the writer\n",
+           frames, trajectory_file, stalls);
+  }
+  if (frame_interval > 0)
+    end_frames();
+  if (energy_interval > 0)
+    end_energy();
+  if (morton_interval > 0)
+    printf("morton reordering: %ld times, %.6f s\n", morton_count, morton_time);
+  if (encounter_interval > 0)
+    printf("close encounters: %lld pairs closer than %.3e m in all checks\n", encounters_total, encounter_distance);
+
+  return gettime() - t0;
 }
 
 /*----------------------------------------------------------------------------*/
+/* print busy time per thread in the force calculation */
 
-static unsigned long
-checksum()
+static void
+print_thread_times()
 {
-  unsigned long checksum = 0;
+  double busy = timing_busy(0, PHASE_FORCES), min = busy, max = busy, sum = 0.0;
+  int i;
 
-  // initialize bodies
-  for (int i = 0; i < n_body; i++)
+  printf("thread  busy time (force calculation)\n");
+  for (i = 0; i < n_threads; i++)
   {
-    // random position vector
-    checksum += (unsigned long)round(bodies[i].position.x);
-    checksum += (unsigned long)round(bodies[i].position.y);
+    busy = timing_busy(i, PHASE_FORCES);
+    printf("%6d  %.6f\n", i, busy);
+    if (busy < min)
+      min = busy;
+    if (busy > max)
+      max = busy;
+    sum += busy;
   }
+  printf("busy time min=%.6f avg=%.6f max=%.6f imbalance (max/avg)=%.3f\n",
+         min, sum / n_threads, max, (sum > 0.0) ? max / (sum / n_threads) : 1.0);
+}
 
-  return checksum;
+/*----------------------------------------------------------------------------*/
+/* run again from the initial bodies in double precision and compare with
+   the results of the single precision run */
+
+static void
+compare_with_double(int window, body_t *initial, double time_float, unsigned long cs_float)
+{
+  vector_t *position_float;
+  double time_double, deviation, max_deviation = 0.0;
+  unsigned long cs_double;
+  int i, shown;
+
+  position_float = malloc(n_body * sizeof(*position_float));
+  if (position_float == NULL)
+  {
+    printf("no more memory\n");
+    exit(1);
+  }
+  for (i = 0; i < n_body; i++)
+    position_float[bodies[i].id] = bodies[i].position;
+
+  memcpy(bodies, initial, n_body * sizeof(*bodies));
+  set_precision(0);
+  // the reference run is not shown
+  shown = display;
+  display = 0;
+  time_double = time_loop(window);
+  display = shown;
+  cs_double = checksum();
+
+  for (i = 0; i < n_body; i++)
+  {
+    deviation = sqrt(SQR(bodies[i].position.x - position_float[bodies[i].id].x) + SQR(bodies[i].position.y - position_float[bodies[i].id].y));
+    max_deviation = MAX(max_deviation, deviation);
+  }
+
+  printf("precision comparison (float forces vs. double):\n"
+         "\ttime double        : %.6f\n"
+         "\ttime float         : %.6f\n"
+         "\tspeedup            : %.2f\n"
+         "\tchecksum double    : %lu\n"
+         "\tchecksum float     : %lu\n"
+         "\tchecksum deviation : %ld\n"
+         "\tmax position deviation : %.6e m (%.3e of distance factor)\n",
+         time_double, time_float, (time_float > 0.0) ? time_double / time_float : 0.0,
+         cs_double, cs_float, (long)(cs_float - cs_double),
+         max_deviation, max_deviation / body_distance_factor);
+
+  free(position_float);
+}
+
+/*----------------------------------------------------------------------------*/
+/* ensemble of independent small systems
+
+   Every line of the ensemble file describes one system, using the
+   command line options of the solar system variants:
+     -solar_system|-solar_system2|-solar_system3 -t_end t [-timesteps dt]
+     [-massscale m] [-velocityscale v]
+   The masses of all bodies except the sun are multiplied with m, all
+   velocities with v. Lines starting with # are ignored. Every system is
+   calculated by one thread; the systems are distributed dynamically. */
+
+#define ENSEMBLE_LINE 1024
+
+typedef struct
+{
+  int scenario;          // 1, 2, 3 as use_solar_system
+  double t_end;          // end time
+  double dt;             // timestep
+  double mass_scale;     // factor for planet masses
+  double velocity_scale; // factor for velocities
+  int n;                 // number of bodies
+  long steps;            // timesteps done
+  double time;           // calculation time
+  unsigned long checksum;
+} system_t;
+
+/*----------------------------------------------------------------------------*/
+/* read the ensemble file, returns the number of systems */
+
+static int
+read_ensemble(system_t **systems)
+{
+  char line[ENSEMBLE_LINE], *token;
+  int n = 0, capacity = 0, line_no = 0, ok;
+  FILE *f = fopen(ensemble_file, "r");
+
+  if (f == NULL)
+  {
+    printf("error: can't open ensemble file %s\n", ensemble_file);
+    exit(1);
+  }
+
+  *systems = NULL;
+  while (fgets(line, sizeof(line), f) != NULL)
+  {
+    system_t s = {0, INFINITY, 6 * 60 * 60, 1.0, 1.0, 0, 0, 0.0, 0};
+
+    line_no++;
+    token = strtok(line, " \t\r\n");
+    if ((token == NULL) || (token[0] == '#'))
+      continue;
+
+    ok = 1;
+    for (; ok && (token != NULL); token = strtok(NULL, " \t\r\n"))
+    {
+      if (!strcmp("-solar_system", token))
+        s.scenario = 1;
+      else if (!strcmp("-solar_system2", token))
+        s.scenario = 2;
+      else if (!strcmp("-solar_system3", token))
+        s.scenario = 3;
+      else if (!strcmp("-t_end", token))
+        ok = ((token = strtok(NULL, " \t\r\n")) != NULL) && (sscanf(token, "%lf", &s.t_end) == 1);
+      else if (!strcmp("-timesteps", token))
+        ok = ((token = strtok(NULL, " \t\r\n")) != NULL) && (sscanf(token, "%lf", &s.dt) == 1) && (s.dt > 0.0);
+      else if (!strcmp("-massscale", token))
+        ok = ((token = strtok(NULL, " \t\r\n")) != NULL) && (sscanf(token, "%lf", &s.mass_scale) == 1);
+      else if (!strcmp("-velocityscale", token))
+        ok = ((token = strtok(NULL, " \t\r\n")) != NULL) && (sscanf(token, "%lf", &s.velocity_scale) == 1);
+      else
+        ok = 0;
+    }
+    if (!ok || (s.scenario == 0))
+    {
+      printf("error: %s line %d: wrong system description\n", ensemble_file, line_no);
+      exit(1);
+    }
+    // a system without end would stop the whole ensemble
+    if (!isfinite(s.t_end))
+    {
+      printf("error: %s line %d: system needs a finite -t_end\n", ensemble_file, line_no);
+      exit(1);
+    }
+
+    s.n = (s.scenario == 1) ? SOLAR_LARGE - 1 : (s.scenario == 2) ? SOLAR_SMALL : SOLAR_LARGE;
+    if (n == capacity)
+    {
+      capacity = 2 * capacity + 16;
+      *systems = realloc(*systems, capacity * sizeof(**systems));
+      if (*systems == NULL)
+      {
+        printf("no more memory\n");
+        exit(1);
+      }
+    }
+    (*systems)[n++] = s;
+  }
+
+  fclose(f);
+  return n;
+}
+
+/*----------------------------------------------------------------------------*/
+/* calculate one system sequentially (same arithmetic as the time loop) */
+
+static void
+run_system(system_t *s)
+{
+  body_t b[SOLAR_LARGE];
+  vector_t force[SOLAR_LARGE], delta_v, delta_p;
+  double t_sys, t0 = omp_get_wtime();
+  int i;
+
+  memcpy(b, solar_system, s->n * sizeof(*b));
+  for (i = 0; i < s->n; i++)
+  {
+    if (i > 0)
+      b[i].mass *= s->mass_scale;
+    b[i].velocity.x *= s->velocity_scale;
+    b[i].velocity.y *= s->velocity_scale;
+  }
+
+  for (t_sys = 0; t_sys < s->t_end; t_sys += s->dt)
+  {
+    for (i = 0; i < s->n; i++)
+      force[i].x = force[i].y = 0.0;
+    for (i = 0; i < s->n - 1; i++)
+      row_forces(b, s->n, force, i, 0);
+
+    for (i = 0; i < s->n; i++)
+    {
+      delta_v.x = force[i].x / b[i].mass * s->dt;
+      delta_v.y = force[i].y / b[i].mass * s->dt;
+      delta_p.x = (b[i].velocity.x + delta_v.x / 2.0) * s->dt;
+      delta_p.y = (b[i].velocity.y + delta_v.y / 2.0) * s->dt;
+      b[i].velocity.x += delta_v.x;
+      b[i].velocity.y += delta_v.y;
+      b[i].position.x += delta_p.x;
+      b[i].position.y += delta_p.y;
+    }
+    s->steps++;
+  }
+
+  s->checksum = checksum_of(b, s->n);
+  s->time = omp_get_wtime() - t0;
+}
+
+/*----------------------------------------------------------------------------*/
+
+static void
+run_ensemble()
+{
+  static const char *names[] = {"", "solar_system", "solar_system2", "solar_system3"};
+  system_t *systems;
+  int n_systems = read_ensemble(&systems);
+  double t0, sum = 0.0, max = 0.0;
+  long long steps = 0;
+  int i;
+
+  t0 = gettime();
+#pragma omp parallel for schedule(dynamic, 1)
+  for (i = 0; i < n_systems; i++)
+    run_system(&systems[i]);
+  t0 = gettime() - t0;
+
+  printf("system  scenario       bodies  m-scale  v-scale      steps    time [s]  checksum\n");
+  for (i = 0; i < n_systems; i++)
+  {
+    printf("%6d  %-13s  %6d  %7.4f  %7.4f  %9ld  %10.6f  %lu\n",
+           i, names[systems[i].scenario], systems[i].n, systems[i].mass_scale, systems[i].velocity_scale,
+           systems[i].steps, systems[i].time, systems[i].checksum);
+    sum += systems[i].time;
+    max = MAX(max, systems[i].time);
+    steps += systems[i].steps;
+  }
+  printf("ensemble: %d systems, %lld timesteps with %d threads\n"
+         "time ensemble : %.6f (%.1f systems/s, %.0f timesteps/s)\n"
+         "system times  : sum %.6f, max %.6f, sum/(threads*time) = %.3f\n",
+         n_systems, steps, omp_get_max_threads(),
+         t0, (t0 > 0.0) ? n_systems / t0 : 0.0, (t0 > 0.0) ? steps / t0 : 0.0,
+         sum, max, (t0 > 0.0) ? sum / (omp_get_max_threads() * t0) : 0.0);
+
+  free(systems);
 }
 
 /*----------------------------------------------------------------------------*/
@@ -430,27 +2683,41 @@ int main(int argc, char **argv)
 {
   double t0;
   int window = 0;
+  body_t *initial = NULL;
 
   get_options(argc, argv);
+  if (ensemble_file != NULL)
+  {
+    run_ensemble();
+    return 0;
+  }
   init();
+  init_threads();
+  timing_start(PHASES, phase_names, n_threads, trace_file);
+  set_precision(use_float);
+  if (compare_precision)
+  {
+    // keep the initial bodies for the second run
+    initial = malloc(n_body * sizeof(*initial));
+    if (initial == NULL)
+    {
+      printf("no more memory\n");
+      exit(1);
+    }
+    memcpy(initial, bodies, n_body * sizeof(*initial));
+  }
   if (display)
     window = graphic_start(size_x, size_y, "N-Body");
 
   /* time loop */
-  t0 = gettime();
-  for (t = 0; t < t_end; t += dt)
-  {
-    // draw bodies
-    show_bodies(window);
-
-    // computation
-    calculate_forces();
-    move_bodies();
-  }
+  t0 = time_loop(window);
 
   // print out calculation speed every second
-  t0 = gettime() - t0;
   printf("time nbody : %.6f\n", t0);
+  if (t0 > 0.0)
+    printf("timesteps per second : %.0f\n", ceil((t_end - t_start) / dt) / t0);
+  if (checkpoints_skipped > 0)
+    printf("checkpoints skipped (writer busy) : %ld\n", checkpoints_skipped);
   unsigned long cs = checksum();
   if (abs(cs - CHECKSUM_REFERENCE) > 2)
     printf("error checksum wrong:\n"
@@ -460,6 +2727,20 @@ int main(int argc, char **argv)
   else
     printf("checksum OK: %lu\n", cs);
 
+  if (show_phase_times)
+    timing_report(t0);
+
+  if (compare_precision)
+    compare_with_double(window, initial, t0, cs);
+
+  if (block_levels > 0)
+    print_blocksteps();
+
+  if (show_thread_times)
+    print_thread_times();
+
+  timing_end();
+
   if (display)
     graphic_end(window);
 
@@ -0,0 +1,211 @@
+/*==============================================================================
+
+   Purpose:    off-screen rendering of bodies into a frame buffer
+
+==============================================================================*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <omp.h>
+
+#include "render.h"
+
+/*----------------------------------------------------------------------------*/
+/* macros */
+
+#define TILE 32 // tile size in pixels
+
+#define MIN(x, y) (((x) < (y)) ? (x) : (y))
+#define MAX(x, y) (((x) > (y)) ? (x) : (y))
+
+/*----------------------------------------------------------------------------*/
+/* variables
+
+   The image is divided into tiles of TILE x TILE pixels. Every circle is
+   sorted into all tiles it overlaps (counting sort), then the tiles are
+   rendered in parallel and every pixel is written by one thread only.
+   Colors are added with saturation, which does not depend on the order of
+   the circles, so the image is the same for any number of threads. */
+
+static int width, height;            // image size
+static int tiles_x, tiles_y;         // number of tiles
+static unsigned char *pixels;        // RGB frame buffer
+static int *tile_start;              // first entry of every tile in tile_splat
+static int *tile_fill;               // next free entry while sorting
+static int *tile_splat;              // circles sorted by tile
+static int tile_capacity;            // size of tile_splat
+
+static const unsigned char palette[][3] = {
+    {255, 64, 64}, {64, 255, 64}, {64, 64, 255}, {255, 255, 64},
+    {255, 64, 255}, {64, 255, 255}, {255, 160, 64}, {160, 160, 255}};
+#define N_COLORS (int)(sizeof(palette) / sizeof(palette[0]))
+
+/*----------------------------------------------------------------------------*/
+
+void render_init(int w, int h)
+{
+  width = w;
+  height = h;
+  tiles_x = (width + TILE - 1) / TILE;
+  tiles_y = (height + TILE - 1) / TILE;
+
+  pixels = malloc((size_t)width * height * 3);
+  tile_start = malloc((tiles_x * tiles_y + 1) * sizeof(*tile_start));
+  tile_fill = malloc(tiles_x * tiles_y * sizeof(*tile_fill));
+  tile_splat = NULL;
+  tile_capacity = 0;
+  if ((pixels == NULL) || (tile_start == NULL) || (tile_fill == NULL))
+  {
+    printf("no more memory\n");
+    exit(1);
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+/* range of tiles covered by a circle, returns 0 if it is not on screen */
+
+static int
+tile_range(const splat_t *s, int *tx0, int *tx1, int *ty0, int *ty1)
+{
+  float x0 = s->x - s->radius, x1 = s->x + s->radius;
+  float y0 = s->y - s->radius, y1 = s->y + s->radius;
+
+  if ((x1 < 0.0f) || (y1 < 0.0f) || (x0 >= width) || (y0 >= height))
+    return 0;
+
+  *tx0 = (int)MAX(0.0f, x0) / TILE;
+  *tx1 = (int)MIN(width - 1.0f, x1) / TILE;
+  *ty0 = (int)MAX(0.0f, y0) / TILE;
+  *ty1 = (int)MIN(height - 1.0f, y1) / TILE;
+  return 1;
+}
+
+/*----------------------------------------------------------------------------*/
+/* add circle s to the pixels of tile (tx,ty) */
+
+static void
+splat(const splat_t *s, int tx, int ty)
+{
+  const unsigned char *c = palette[s->color % N_COLORS];
+  int px0 = (int)MAX((float)(tx * TILE), floorf(s->x - s->radius));
+  int px1 = (int)MIN((float)(MIN((tx + 1) * TILE, width) - 1), ceilf(s->x + s->radius));
+  int py0 = (int)MAX((float)(ty * TILE), floorf(s->y - s->radius));
+  int py1 = (int)MIN((float)(MIN((ty + 1) * TILE, height) - 1), ceilf(s->y + s->radius));
+  float r2 = s->radius * s->radius;
+  int px, py, k;
+
+  for (py = py0; py <= py1; py++)
+    for (px = px0; px <= px1; px++)
+      if ((px - s->x) * (px - s->x) + (py - s->y) * (py - s->y) <= r2)
+      {
+        unsigned char *p = pixels + ((size_t)py * width + px) * 3;
+        for (k = 0; k < 3; k++)
+          p[k] = (unsigned char)MIN(255, p[k] + c[k]);
+      }
+}
+
+/*----------------------------------------------------------------------------*/
+
+void render_frame_team(int n, const splat_t splats[n])
+{
+  int n_tiles = tiles_x * tiles_y;
+  int i, tx, ty, tx0, tx1, ty0, ty1;
+
+#pragma omp single nowait
+  memset(tile_start, 0, (n_tiles + 1) * sizeof(*tile_start));
+
+  // clear frame buffer, the barrier also waits for the memset
+#pragma omp for schedule(static)
+  for (i = 0; i < height; i++)
+    memset(pixels + (size_t)i * width * 3, 0, (size_t)width * 3);
+
+  // count circles per tile
+#pragma omp for schedule(static)
+  for (i = 0; i < n; i++)
+    if (tile_range(&splats[i], &tx0, &tx1, &ty0, &ty1))
+      for (ty = ty0; ty <= ty1; ty++)
+        for (tx = tx0; tx <= tx1; tx++)
+        {
+#pragma omp atomic
+          tile_start[ty * tiles_x + tx + 1]++;
+        }
+
+#pragma omp single
+  {
+    int k;
+    for (k = 0; k < n_tiles; k++)
+    {
+      tile_start[k + 1] += tile_start[k];
+      tile_fill[k] = tile_start[k];
+    }
+    if (tile_start[n_tiles] > tile_capacity)
+    {
+      tile_capacity = tile_start[n_tiles];
+      free(tile_splat);
+      tile_splat = malloc(tile_capacity * sizeof(*tile_splat));
+      if (tile_splat == NULL)
+      {
+        printf("no more memory\n");
+        exit(1);
+      }
+    }
+  }
+
+  // sort circles into tiles
+#pragma omp for schedule(static)
+  for (i = 0; i < n; i++)
+    if (tile_range(&splats[i], &tx0, &tx1, &ty0, &ty1))
+      for (ty = ty0; ty <= ty1; ty++)
+        for (tx = tx0; tx <= tx1; tx++)
+        {
+          int pos;
+#pragma omp atomic capture
+          pos = tile_fill[ty * tiles_x + tx]++;
+          tile_splat[pos] = i;
+        }
+
+  // render tiles
+#pragma omp for schedule(dynamic)
+  for (i = 0; i < n_tiles; i++)
+  {
+    int k;
+    for (k = tile_start[i]; k < tile_start[i + 1]; k++)
+      splat(&splats[tile_splat[k]], i % tiles_x, i / tiles_x);
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+
+void render_frame(int n, const splat_t splats[n])
+{
+#pragma omp parallel
+  render_frame_team(n, splats);
+}
+
+/*----------------------------------------------------------------------------*/
+
+int render_write(FILE *f)
+{
+  size_t n = (size_t)width * height * 3;
+
+  if (fprintf(f, "P6\n%d %d\n255\n", width, height) < 0)
+    return 1;
+  return fwrite(pixels, 1, n, f) != n;
+}
+
+/*----------------------------------------------------------------------------*/
+
+void render_end()
+{
+  free(pixels);
+  free(tile_start);
+  free(tile_fill);
+  free(tile_splat);
+}
+
+/*============================================================================*
+ *                             that's all folks                               *
+ *============================================================================*/
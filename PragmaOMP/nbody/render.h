@@ -0,0 +1,43 @@
+/*==============================================================================
+
+   Purpose:    off-screen rendering of bodies into a frame buffer
+
+==============================================================================*/
+
+#if !defined(RENDER_H_INCLUDED)
+#define RENDER_H_INCLUDED
+
+#include <stdio.h>
+
+/*============================================================================*/
+/* types */
+
+// one filled circle in screen coordinates
+typedef struct
+{
+  float x;      // center
+  float y;
+  float radius; // radius in pixels
+  int color;    // index into the color palette
+} splat_t;
+
+/*============================================================================*/
+/* functions */
+
+/* create a frame buffer of width x height pixels */
+extern void render_init(int width, int height);
+/* render n circles additively on black background (parallel) */
+extern void render_frame(int n, const splat_t splats[n]);
+/* the same, called by all threads of a parallel region (orphaned
+   worksharing, ends with a barrier) */
+extern void render_frame_team(int n, const splat_t splats[n]);
+/* write the frame buffer as binary PPM image, returns 0 on success */
+extern int render_write(FILE *f);
+/* free the frame buffer */
+extern void render_end(void);
+
+#endif
+
+/*============================================================================*
+ *                             that's all folks                               *
+ *============================================================================*/
@@ -0,0 +1,245 @@
+/*==============================================================================
+
+   Purpose:    per phase and per thread timing of the N-body time loop
+
+==============================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <omp.h>
+
+#include "timing.h"
+
+/*----------------------------------------------------------------------------*/
+/* macros */
+
+#define LINE_DOUBLES 8            // doubles in a cache line
+#define TRACE_MAX_EVENTS (1 << 20) // max. intervals kept per thread
+
+#define MIN(x, y) (((x) < (y)) ? (x) : (y))
+#define MAX(x, y) (((x) > (y)) ? (x) : (y))
+
+/*----------------------------------------------------------------------------*/
+/* types */
+
+// one interval for the trace
+typedef struct
+{
+  int phase;
+  double begin;
+  double end;
+} event_t;
+
+// trace of one thread, padded to a cache line
+typedef struct
+{
+  event_t *events;
+  long n;
+  long capacity;
+  long dropped;
+  char pad[64 - sizeof(event_t *) - 3 * sizeof(long)];
+} trace_t;
+
+/*----------------------------------------------------------------------------*/
+/* variables
+
+   Every thread writes only its own row of busy (rows are padded to whole
+   cache lines) and its own trace. The wall times are written by one thread
+   at a time. The trace has one row more for the wall times. */
+
+static int n_phases, n_threads;
+static const char *const *phase_names;
+static const char *trace_name;
+static double t_origin;     // begin of timing
+static double *wall;        // wall time per phase
+static long *calls;         // number of wall time measurements per phase
+static double *busy;        // work time per thread and phase
+static int stride;          // row length of busy
+static trace_t *traces;     // n_threads + 1 traces, NULL if not traced
+
+/*----------------------------------------------------------------------------*/
+
+void timing_start(int phases, const char *const names[], int threads, const char *trace_file)
+{
+  n_phases = phases;
+  n_threads = threads;
+  phase_names = names;
+  trace_name = trace_file;
+  stride = (n_phases + LINE_DOUBLES - 1) / LINE_DOUBLES * LINE_DOUBLES;
+
+  wall = calloc(n_phases, sizeof(*wall));
+  calls = calloc(n_phases, sizeof(*calls));
+  busy = calloc((size_t)n_threads * stride, sizeof(*busy));
+  traces = (trace_file != NULL) ? calloc(n_threads + 1, sizeof(*traces)) : NULL;
+  if ((wall == NULL) || (calls == NULL) || (busy == NULL) || ((trace_file != NULL) && (traces == NULL)))
+  {
+    printf("no more memory\n");
+    exit(1);
+  }
+
+  t_origin = omp_get_wtime();
+}
+
+/*----------------------------------------------------------------------------*/
+/* keep an interval in trace k */
+
+static void
+trace(int k, int phase, double begin, double end)
+{
+  trace_t *tr = &traces[k];
+
+  if (tr->n == tr->capacity)
+  {
+    if (tr->capacity >= TRACE_MAX_EVENTS)
+    {
+      tr->dropped++;
+      return;
+    }
+    tr->capacity = MIN(TRACE_MAX_EVENTS, 2 * tr->capacity + 1024);
+    tr->events = realloc(tr->events, tr->capacity * sizeof(*tr->events));
+    if (tr->events == NULL)
+    {
+      printf("no more memory\n");
+      exit(1);
+    }
+  }
+  tr->events[tr->n].phase = phase;
+  tr->events[tr->n].begin = begin;
+  tr->events[tr->n].end = end;
+  tr->n++;
+}
+
+/*----------------------------------------------------------------------------*/
+
+void timing_wall(int phase, double t_begin)
+{
+  double t_end = omp_get_wtime();
+
+  wall[phase] += t_end - t_begin;
+  calls[phase]++;
+  if (traces != NULL)
+    trace(n_threads, phase, t_begin, t_end);
+}
+
+/*----------------------------------------------------------------------------*/
+
+void timing_work(int phase, double t_begin)
+{
+  double t_end = omp_get_wtime();
+  int tid = omp_get_thread_num();
+
+  busy[(size_t)tid * stride + phase] += t_end - t_begin;
+  if (traces != NULL)
+    trace(tid, phase, t_begin, t_end);
+}
+
+/*----------------------------------------------------------------------------*/
+
+double timing_busy(int tid, int phase)
+{
+  return busy[(size_t)tid * stride + phase];
+}
+
+/*----------------------------------------------------------------------------*/
+
+void timing_report(double loop_time)
+{
+  double sum_wall = 0.0;
+  int p, k;
+
+  printf("phase          calls     wall [s]  loop [%%]  work sum [s]  work min [s]  work max [s]  efficiency\n");
+  for (p = 0; p < n_phases; p++)
+  {
+    double sum = 0.0, min = busy[p], max = busy[p];
+    for (k = 0; k < n_threads; k++)
+    {
+      sum += busy[(size_t)k * stride + p];
+      min = MIN(min, busy[(size_t)k * stride + p]);
+      max = MAX(max, busy[(size_t)k * stride + p]);
+    }
+    if (calls[p] == 0)
+      continue;
+    if (sum > 0.0)
+      printf("%-12s %7ld %12.6f %9.1f %13.6f %13.6f %13.6f %11.3f\n",
+             phase_names[p], calls[p], wall[p], (loop_time > 0.0) ? 100.0 * wall[p] / loop_time : 0.0,
+             sum, min, max, (wall[p] > 0.0) ? sum / (n_threads * wall[p]) : 0.0);
+    else
+      // work of the threads is not measured in this phase
+      printf("%-12s %7ld %12.6f %9.1f %13s %13s %13s %11s\n",
+             phase_names[p], calls[p], wall[p], (loop_time > 0.0) ? 100.0 * wall[p] / loop_time : 0.0,
+             "-", "-", "-", "-");
+    sum_wall += wall[p];
+  }
+  printf("%-12s %7s %12.6f %9.1f\n", "other", "", loop_time - sum_wall,
+         (loop_time > 0.0) ? 100.0 * (loop_time - sum_wall) / loop_time : 0.0);
+
+  // idle = time a thread is not working in any of the phases
+  printf("thread      work [s]     idle [s]  idle [%%]\n");
+  for (k = 0; k < n_threads; k++)
+  {
+    double work = 0.0;
+    for (p = 0; p < n_phases; p++)
+      work += busy[(size_t)k * stride + p];
+    printf("%6d  %12.6f %12.6f %9.1f\n", k, work, sum_wall - work,
+           (sum_wall > 0.0) ? 100.0 * (sum_wall - work) / sum_wall : 0.0);
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+
+void timing_end()
+{
+  long events = 0, dropped = 0;
+  int k;
+
+  if (traces != NULL)
+  {
+    FILE *f = fopen(trace_name, "w");
+    if (f == NULL)
+      printf("error: can't open trace file %s\n", trace_name);
+    else
+    {
+      // Chrome trace event format, complete events in microseconds
+      fprintf(f, "{\"traceEvents\":[\n");
+      for (k = 0; k <= n_threads; k++)
+      {
+        if (k < n_threads)
+          fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}},\n", k, k);
+        else
+          fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"phases (wall)\"}},\n", k);
+      }
+      for (k = 0; k <= n_threads; k++)
+      {
+        long i;
+        for (i = 0; i < traces[k].n; i++)
+        {
+          const event_t *e = &traces[k].events[i];
+          fprintf(f, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f},\n",
+                  phase_names[e->phase], k, 1e6 * (e->begin - t_origin), 1e6 * (e->end - e->begin));
+        }
+        events += traces[k].n;
+        dropped += traces[k].dropped;
+      }
+      // last entry without comma
+      fprintf(f, "{\"name\":\"end\",\"ph\":\"i\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"s\":\"g\"}\n]}\n",
+              n_threads, 1e6 * (omp_get_wtime() - t_origin));
+      if (fclose(f) != 0)
+        printf("error: can't write trace file %s\n", trace_name);
+      else
+        printf("trace: %ld intervals written to %s (%ld dropped)\n", events, trace_name, dropped);
+    }
+    for (k = 0; k <= n_threads; k++)
+      free(traces[k].events);
+    free(traces);
+    traces = NULL;
+  }
+
+  free(wall);
+  free(calls);
+  free(busy);
+}
+
+/*============================================================================*
+ *                             that's all folks                               *
+ *============================================================================*/
@@ -0,0 +1,41 @@
+/*==============================================================================
+
+   Purpose:    per phase and per thread timing of the N-body time loop
+
+==============================================================================*/
+
+#if !defined(TIMING_H_INCLUDED)
+#define TIMING_H_INCLUDED
+
+/*============================================================================*/
+/* usage
+
+   The time loop is divided into phases. For every phase the wall time is
+   measured by one thread (timing_wall()), and every thread measures the
+   time it works in the phase (timing_work()), without waiting in barriers.
+   The difference of both is the idle time of a thread. A phase executed by
+   one thread only calls both functions. */
+
+/*============================================================================*/
+/* functions */
+
+/* start timing of n_phases phases with the given names for n_threads
+   threads; if trace_file is not NULL, all intervals are kept and written
+   as Chrome trace (chrome://tracing, Perfetto) by timing_end() */
+extern void timing_start(int n_phases, const char *const names[], int n_threads, const char *trace_file);
+/* wall time of phase since t_begin (omp_get_wtime()), called by one thread */
+extern void timing_wall(int phase, double t_begin);
+/* work time of the calling thread in phase since t_begin */
+extern void timing_work(int phase, double t_begin);
+/* accumulated work time of thread tid in phase */
+extern double timing_busy(int tid, int phase);
+/* print a summary table, loop_time is the time of the whole time loop */
+extern void timing_report(double loop_time);
+/* write the trace file and free all data */
+extern void timing_end(void);
+
+#endif
+
+/*============================================================================*
+ *                             that's all folks                               *
+ *============================================================================*/
@@ -0,0 +1,170 @@
+/*==============================================================================
+
+   Purpose:    asynchronous trajectory output for the N-body calculation
+
+==============================================================================*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include <pthread.h>
+
+#include "trajectory.h"
+
+/*----------------------------------------------------------------------------*/
+/* variables
+
+   Single producer / single consumer ring buffer without locks: the time
+   loop only writes head, the writer thread only writes tail. Frame k is in
+   slot k % n_slots and is valid for tail <= k < head. */
+
+static pthread_t writer;
+static FILE *file;
+static int64_t n_body;
+
+static int n_slots;                 // number of frames in the ring buffer
+static double *positions;           // frame buffers (n_slots x 2 x n_body)
+static trajectory_frame_t *frames;  // frame headers
+static atomic_long head;            // next frame to be filled
+static atomic_long tail;            // next frame to be written
+static atomic_int done;             // no more frames will come
+
+static long stalls; // waits of the time loop for a free slot
+
+/*----------------------------------------------------------------------------*/
+
+static void
+pause_briefly()
+{
+  struct timespec ts = {0, 100000}; // 0.1 ms
+
+  nanosleep(&ts, NULL);
+}
+
+/*----------------------------------------------------------------------------*/
+
+static void *
+writer_thread(void *arg)
+{
+  long k = atomic_load_explicit(&tail, memory_order_relaxed);
+  size_t n = 2 * (size_t)n_body;
+
+  for (;;)
+  {
+    if (k == atomic_load_explicit(&head, memory_order_acquire))
+    {
+      // nothing to write, check for end after a last look at head
+      if (atomic_load_explicit(&done, memory_order_acquire) &&
+          (k == atomic_load_explicit(&head, memory_order_acquire)))
+        break;
+      pause_briefly();
+      continue;
+    }
+
+    if ((fwrite(&frames[k % n_slots], sizeof(*frames), 1, file) != 1) ||
+        (fwrite(positions + (k % n_slots) * n, sizeof(*positions), n, file) != n))
+      printf("error: can't write trajectory frame %ld\n", (long)frames[k % n_slots].step);
+
+    atomic_store_explicit(&tail, ++k, memory_order_release);
+  }
+
+  return NULL;
+}
+
+/*----------------------------------------------------------------------------*/
+
+void trajectory_start(const char *filename, const trajectory_header_t *header, int slots)
+{
+  trajectory_header_t h = *header;
+
+  file = fopen(filename, "wb");
+  if (file == NULL)
+  {
+    printf("error: can't open trajectory file %s\n", filename);
+    exit(1);
+  }
+  memcpy(h.magic, TRAJECTORY_MAGIC, sizeof(h.magic));
+  if (fwrite(&h, sizeof(h), 1, file) != 1)
+    printf("error: can't write trajectory file %s\n", filename);
+
+  n_body = h.n_body;
+  n_slots = slots;
+  positions = malloc((size_t)n_slots * 2 * n_body * sizeof(*positions));
+  frames = malloc(n_slots * sizeof(*frames));
+  if ((positions == NULL) || (frames == NULL))
+  {
+    printf("no more memory\n");
+    exit(1);
+  }
+
+  atomic_init(&head, 0);
+  atomic_init(&tail, 0);
+  atomic_init(&done, 0);
+  stalls = 0;
+
+  if (pthread_create(&writer, NULL, writer_thread, NULL) != 0)
+  {
+    printf("error: can't create trajectory writer thread\n");
+    exit(1);
+  }
+}
+
+/*----------------------------------------------------------------------------*/
+
+double *
+trajectory_slot()
+{
+  long k = atomic_load_explicit(&head, memory_order_relaxed);
+
+  if (k - atomic_load_explicit(&tail, memory_order_acquire) >= n_slots)
+  {
+    // ring buffer full, the writer is too slow
+    stalls++;
+    while (k - atomic_load_explicit(&tail, memory_order_acquire) >= n_slots)
+      pause_briefly();
+  }
+
+  return positions + (k % n_slots) * 2 * (size_t)n_body;
+}
+
+/*----------------------------------------------------------------------------*/
+
+void trajectory_push(int64_t step, double t)
+{
+  long k = atomic_load_explicit(&head, memory_order_relaxed);
+
+  frames[k % n_slots].step = step;
+  frames[k % n_slots].t = t;
+  atomic_store_explicit(&head, k + 1, memory_order_release);
+}
+
+/*----------------------------------------------------------------------------*/
+
+long trajectory_stop()
+{
+  atomic_store_explicit(&done, 1, memory_order_release);
+  pthread_join(writer, NULL);
+
+  if (fclose(file) != 0)
+    printf("error: can't write trajectory file\n");
+  free(positions);
+  free(frames);
+
+  return atomic_load(&tail);
+}
+
+/*----------------------------------------------------------------------------*/
+
+long trajectory_stalls()
+{
+  return stalls;
+}
+
+/*============================================================================*
+ *                             that's all folks                               *
+ *============================================================================*/
@@ -0,0 +1,57 @@
+/*==============================================================================
+
+   Purpose:    asynchronous trajectory output for the N-body calculation
+
+==============================================================================*/
+
+#if !defined(TRAJECTORY_H_INCLUDED)
+#define TRAJECTORY_H_INCLUDED
+
+#include <stdint.h>
+
+/*============================================================================*/
+/* file format
+
+   A trajectory file starts with the file header. Every frame is a frame
+   header followed by the x and the y coordinates of all bodies (n_body
+   doubles each). */
+
+#define TRAJECTORY_MAGIC "NBODYTR1"
+
+typedef struct
+{
+  char magic[8];          // TRAJECTORY_MAGIC
+  int64_t n_body;         // number of bodies
+  int64_t stride;         // timesteps between two frames
+  double dt;              // timestep
+  double distance_factor; // body distance factor
+  double reserved[3];
+} trajectory_header_t;
+
+typedef struct
+{
+  int64_t step; // timestep of the frame
+  double t;     // simulated time of the frame
+} trajectory_frame_t;
+
+/*============================================================================*/
+/* functions */
+
+/* open filename and start the writer thread with a ring buffer of slots frames */
+extern void trajectory_start(const char *filename, const trajectory_header_t *header, int slots);
+/* next free frame buffer (x coordinates followed by y coordinates),
+   waits if the ring buffer is full */
+extern double *trajectory_slot(void);
+/* hand the filled frame buffer to the writer thread */
+extern void trajectory_push(int64_t step, double t);
+/* write all remaining frames, stop the writer thread and close the file,
+   returns the number of frames written */
+extern long trajectory_stop(void);
+/* number of times the time loop had to wait for a free frame buffer */
+extern long trajectory_stalls(void);
+
+#endif
+
+/*============================================================================*
+ *                             that's all folks                               *
+ *============================================================================*/